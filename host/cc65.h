@@ -0,0 +1,14 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * NATIVE BUILD SHIM: COMPILER SUPPORT                                      *
+ ****************************************************************************/
+
+// Nothing of the cc65 support is used by the native build.
+
+#ifndef _CC65_H
+#define _CC65_H
+
+#endif
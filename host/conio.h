@@ -0,0 +1,17 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * NATIVE BUILD SHIM: CONSOLE                                               *
+ ****************************************************************************/
+
+// The keyboard of the native build is a script of keys (see host.c).
+
+#ifndef _CONIO_H
+#define _CONIO_H
+
+unsigned char kbhit(void);
+char cgetc(void);
+
+#endif
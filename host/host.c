@@ -0,0 +1,362 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * NATIVE BUILD SHIM                                                        *
+ ****************************************************************************/
+
+// This is the support of the native build (see host.h). The program is
+// started by this main(), that reads the options:
+//
+//   demo.host [-k <keys>] [-b <us>] [-o <ms>] [-t <ms>] [-m <module>=<bytes>]... [-l <file>]
+//
+//   -k  keys typed by the user, one character each (otherwise, they are
+//       read from the standard input); the session ends when they end
+//   -b  microseconds taken by the drive for each byte (default: 2500, as
+//       the KERNAL routines of a 1541, that read about 400 bytes/s)
+//   -o  milliseconds taken by the drive to open a file, that is to look
+//       for it into the directory and to reach its first sector (default:
+//       600)
+//   -t  milliseconds the user thinks, before typing each key (default:
+//       1000): the modules can be loaded in the background meanwhile
+//   -m  size of the file of a module (default: the size of its slot)
+//   -l  file where the names of the modules are written, as they are
+//       opened: it is the sequence of loads read by tools/ovllayout.c
+//
+// At the end of the session it prints, for each module, how many times it
+// has been read and how long it took, and the hits and the misses of the
+// overlay manager. It fails if a module has been replaced while one of
+// its functions was running (see host_check()).
+
+/****************************************************************************
+ ** INCLUDE SECTION
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+
+/****************************************************************************
+ ** DEFINITIONS SECTION
+ ****************************************************************************/
+
+// Default latency model (see above).
+#define BYTE_US             2500L
+#define OPEN_MS             600L
+#define THINK_MS            1000L
+
+// Frequency of the clock of the KERNAL.
+#define JIFFIES             60L
+
+// Time between two consecutive polls of the keyboard.
+#define POLL_US             (1000000L / JIFFIES)
+
+// Files of the simulated drive are numbered from here.
+#define FIRST_FILE          100
+
+// Maximum number of keys of a session.
+#define MAX_KEYS            1024
+
+/****************************************************************************
+ ** VARIABLES SECTION
+ ****************************************************************************/
+
+unsigned char host_overlay_area[HOST_OVERLAYSIZE];
+
+// Latency model, in microseconds.
+static long byte_us = BYTE_US;
+static long open_us = OPEN_MS * 1000L;
+static long think_us = THINK_MS * 1000L;
+
+// Simulated time since the beginning of the session, in microseconds, and
+// the part of it spent by the drive.
+static unsigned long now_us = 0;
+static unsigned long drive_us = 0;
+
+// Size of the file of each module, and the counters of each one.
+static unsigned int file_sizes[OVERLAY_MODULES];
+static unsigned int file_opens[OVERLAY_MODULES];
+static unsigned long file_bytes[OVERLAY_MODULES];
+static unsigned long file_us[OVERLAY_MODULES];
+
+// The file that is open (-1 = none), and the position into it.
+static int open_module = -1;
+static unsigned int open_position;
+
+// Keys of the session, the next one and when it will be typed (0 = the
+// program is not waiting for it yet).
+static char keys[MAX_KEYS];
+static int key_count = 0;
+static int key_next = 0;
+static unsigned long key_time = 0;
+
+// Sequence of the modules opened (NULL = not written).
+static FILE* log_file = NULL;
+
+// Number of modules replaced while running.
+static int errors = 0;
+
+// The main function of the program (see the makefile).
+void program_main(void);
+
+/****************************************************************************
+ ** SIMULATED DRIVE
+ ****************************************************************************/
+
+/**
+ * This function takes "us" microseconds of the drive, charged to the
+ * module "module".
+ */
+static void drive_wait(int module, unsigned long us)
+{
+    now_us += us;
+    drive_us += us;
+    file_us[module] += us;
+}
+
+/**
+ * This function opens the file "name". It returns -1 if there is no such
+ * file, or if another file is already open (the drive has one channel).
+ */
+int host_open(const char* name)
+{
+    int i;
+
+    if (open_module >= 0) {
+        return -1;
+    }
+    for (i = 0; i < OVERLAY_MODULES; ++i) {
+        if (strcmp(overlay_modules[i].name, name) == 0) {
+            open_module = i;
+            open_position = 0;
+            ++file_opens[i];
+            if (log_file != NULL) {
+                fprintf(log_file, "%s\n", name);
+            }
+            drive_wait(i, open_us);
+            return FIRST_FILE + i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * This function reads up to "size" bytes from the file "file". Every byte
+ * of a module is the number of the module itself, so host_check() can
+ * tell which module is into a slot. It returns the number of bytes read,
+ * or -1 if any error occours.
+ */
+int host_read(int file, void* buffer, unsigned int size)
+{
+    unsigned int left;
+
+    if (file != FIRST_FILE + open_module) {
+        return -1;
+    }
+    left = file_sizes[open_module] - open_position;
+    if (size > left) {
+        size = left;
+    }
+    memset(buffer, open_module + 1, size);
+    open_position += size;
+    file_bytes[open_module] += size;
+    drive_wait(open_module, size * byte_us);
+    return (int)size;
+}
+
+/**
+ * This function closes the file "file".
+ */
+int host_close(int file)
+{
+    if (file != FIRST_FILE + open_module) {
+        return -1;
+    }
+    open_module = -1;
+    return 0;
+}
+
+/**
+ * This function returns the simulated jiffies.
+ */
+clock_t host_clock(void)
+{
+    return (clock_t)(now_us / POLL_US);
+}
+
+/****************************************************************************
+ ** SIMULATED KEYBOARD
+ ****************************************************************************/
+
+/**
+ * This function prints the counters of the session.
+ */
+static void report(void)
+{
+    int i;
+
+    printf("host: %-10s %6s %8s %10s\n", "module", "opens", "bytes", "ms");
+    for (i = 0; i < OVERLAY_MODULES; ++i) {
+        printf("host: %-10s %6u %8lu %10lu\n", overlay_modules[i].name, file_opens[i], file_bytes[i], file_us[i] / 1000);
+    }
+    printf("host: hits %u, misses %u\n", overlay_hits, overlay_misses);
+    printf("host: session %lu ms, of which %lu ms spent by the drive\n", now_us / 1000, drive_us / 1000);
+    if (errors) {
+        printf("host: %d modules replaced while running\n", errors);
+    }
+}
+
+/**
+ * This function tells if a key has been typed. The user types the next key
+ * after thinking for a while: meanwhile, the time goes on by a jiffy at
+ * each call. When there are no more keys, the session ends.
+ */
+unsigned char kbhit(void)
+{
+    if (key_next >= key_count) {
+        report();
+        exit(errors ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+    if (key_time == 0) {
+        key_time = now_us + think_us;
+    }
+    if (now_us >= key_time) {
+        return 1;
+    }
+    now_us += POLL_US;
+    return 0;
+}
+
+/**
+ * This function returns the next key, once it has been typed.
+ */
+char cgetc(void)
+{
+    while (!kbhit()) {
+    }
+    key_time = 0;
+    return keys[key_next++];
+}
+
+/****************************************************************************
+ ** SUPPORT FUNCTIONS
+ ****************************************************************************/
+
+/**
+ * This function writes the representation of "value" in base "radix" into
+ * "buffer", as the one of the cc65 library.
+ */
+char* ultoa(unsigned long value, char* buffer, int radix)
+{
+    char digits[33];
+    int length = 0;
+    int i;
+
+    do {
+        digits[length++] = "0123456789abcdefghijklmnopqrstuvwxyz"[value % radix];
+        value /= radix;
+    } while (value != 0);
+    for (i = 0; i < length; ++i) {
+        buffer[i] = digits[length - 1 - i];
+    }
+    buffer[length] = 0;
+    return buffer;
+}
+
+/**
+ * This function checks that the module "module" is still into its slot,
+ * when its function "name" returns.
+ */
+void host_check(unsigned char module, const char* name)
+{
+    const overlay_module* descriptor = &overlay_modules[module - 1];
+    unsigned char i;
+
+    for (i = 0; i < OVERLAY_SLOTS; ++i) {
+        if (overlay_slots[i].module == module) {
+            break;
+        }
+    }
+    if (i == OVERLAY_SLOTS || *(unsigned char*)descriptor->load_address != module) {
+        printf("host: %s() returned into %s, that has been replaced meanwhile\n", name, descriptor->name);
+        ++errors;
+    }
+}
+
+/**
+ * This function reads the options, and it starts the program.
+ */
+int main(int argc, char* argv[])
+{
+    int i;
+    int c;
+
+    for (i = 0; i < OVERLAY_MODULES; ++i) {
+        file_sizes[i] = (unsigned int)(size_t)overlay_modules[i].size;
+    }
+
+    for (i = 1; i < argc; ++i) {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value == NULL) {
+            break;
+        } else if (strcmp(argv[i], "-k") == 0) {
+            strncpy(keys, value, MAX_KEYS - 1);
+            key_count = (int)strlen(keys);
+        } else if (strcmp(argv[i], "-b") == 0) {
+            byte_us = atol(value);
+        } else if (strcmp(argv[i], "-o") == 0) {
+            open_us = atol(value) * 1000L;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            think_us = atol(value) * 1000L;
+        } else if (strcmp(argv[i], "-l") == 0) {
+            log_file = fopen(value, "w");
+            if (log_file == NULL) {
+                perror(value);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-m") == 0) {
+            const char* size = strchr(value, '=');
+            int j;
+            for (j = 0; size != NULL && j < OVERLAY_MODULES; ++j) {
+                if (strncmp(overlay_modules[j].name, value, size - value) == 0 &&
+                            overlay_modules[j].name[size - value] == 0) {
+                    file_sizes[j] = (unsigned int)strtoul(size + 1, NULL, 0);
+                    break;
+                }
+            }
+            if (size == NULL || j == OVERLAY_MODULES) {
+                fprintf(stderr, "host: unknown module into \"%s\"\n", value);
+                return EXIT_FAILURE;
+            }
+            if (file_sizes[j] > (unsigned int)(size_t)overlay_modules[j].size) {
+                fprintf(stderr, "host: %s is larger than its slot\n", overlay_modules[j].name);
+                return EXIT_FAILURE;
+            }
+        } else {
+            break;
+        }
+        ++i;
+    }
+    if (i < argc) {
+        fprintf(stderr, "usage: %s [-k <keys>] [-b <us>] [-o <ms>] [-t <ms>] [-m <module>=<bytes>]... [-l <file>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Keys are read from the standard input, if not given (without the
+    // ends of the lines).
+    if (key_count == 0) {
+        while (key_count < MAX_KEYS - 1 && (c = getchar()) != EOF) {
+            if (c != '\n' && c != '\r') {
+                keys[key_count++] = (char)c;
+            }
+        }
+    }
+
+    program_main();
+
+    report();
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * NATIVE BUILD SHIM: INCLUDE FILE                                          *
+ ****************************************************************************/
+
+// The native build (see "make host") compiles the program and the overlay
+// manager for the host. The code of the modules is linked into the program
+// as usual, while the overlay area is simulated by an array, laid out as
+// the one of the target given by __C64__ (or the VIC-20): the modules are
+// "loaded" into it from a simulated 1541, that takes a configurable time
+// for each byte and for each file opened. The clock of the KERNAL follows
+// the simulated time, so the counters of the overlay manager tell how long
+// the loads would take. See host.c for the options.
+//
+// This file is included by main.h, in place of the symbols written by the
+// linker: the overlay manager reads the modules with open() and read(),
+// that are redirected to the simulated drive.
+
+#ifndef _HOST_H
+#define _HOST_H
+
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+/****************************************************************************
+ ** OVERLAY AREA
+ ****************************************************************************/
+
+// Sizes of the slots, as into the linker configurations (see the cfg
+// directory). The slots are placed one below the other, starting from the
+// end of the overlay area.
+#ifdef __C64__
+    #define HOST_SLOT1SIZE      0x1000
+    #define HOST_SLOT2SIZE      0x0800
+    #define HOST_SLOT3SIZE      0x0400
+#else
+    #define HOST_SLOT1SIZE      0x0400
+    #define HOST_SLOT2SIZE      0x0200
+    #define HOST_SLOT3SIZE      0
+#endif
+
+#define HOST_OVERLAYSIZE        (HOST_SLOT1SIZE + HOST_SLOT2SIZE + HOST_SLOT3SIZE)
+
+extern unsigned char host_overlay_area[HOST_OVERLAYSIZE];
+
+#define HOST_SLOT1START         (host_overlay_area + HOST_SLOT3SIZE + HOST_SLOT2SIZE)
+#define HOST_SLOT2START         (host_overlay_area + HOST_SLOT3SIZE)
+#define HOST_SLOT3START         (host_overlay_area)
+
+// Address and size of each module, as the linker would define them.
+#define HOST_SIZE(size)         ((void*)(size_t)(size))
+
+#define _OVERLAY1_LOAD__        HOST_SLOT1START
+#define _OVERLAY1_SIZE__        HOST_SIZE(HOST_SLOT1SIZE)
+#define _OVERLAY2_LOAD__        HOST_SLOT1START
+#define _OVERLAY2_SIZE__        HOST_SIZE(HOST_SLOT1SIZE)
+#ifdef __C64__
+    #define _OVERLAY3_LOAD__    HOST_SLOT2START
+    #define _OVERLAY3_SIZE__    HOST_SIZE(HOST_SLOT2SIZE)
+    #define _OVERLAY4_LOAD__    HOST_SLOT2START
+    #define _OVERLAY4_SIZE__    HOST_SIZE(HOST_SLOT2SIZE)
+    #define HOST_TEXTSTART      HOST_SLOT3START
+    #define HOST_TEXTSIZE       HOST_SLOT3SIZE
+#else
+    #define _OVERLAY3_LOAD__    HOST_SLOT1START
+    #define _OVERLAY3_SIZE__    HOST_SIZE(HOST_SLOT1SIZE)
+    #define _OVERLAY4_LOAD__    HOST_SLOT1START
+    #define _OVERLAY4_SIZE__    HOST_SIZE(HOST_SLOT1SIZE)
+    #define HOST_TEXTSTART      HOST_SLOT2START
+    #define HOST_TEXTSIZE       HOST_SLOT2SIZE
+#endif
+#define _OVERLAY5_LOAD__        HOST_TEXTSTART
+#define _OVERLAY5_SIZE__        HOST_SIZE(HOST_TEXTSIZE)
+#define _OVERLAY6_LOAD__        HOST_TEXTSTART
+#define _OVERLAY6_SIZE__        HOST_SIZE(HOST_TEXTSIZE)
+#define _OVERLAY7_LOAD__        HOST_TEXTSTART
+#define _OVERLAY7_SIZE__        HOST_SIZE(HOST_TEXTSIZE)
+#define _OVERLAY8_LOAD__        HOST_TEXTSTART
+#define _OVERLAY8_SIZE__        HOST_SIZE(HOST_TEXTSIZE)
+
+/****************************************************************************
+ ** SIMULATED DRIVE AND CLOCK
+ ****************************************************************************/
+
+int host_open(const char* name);
+int host_read(int file, void* buffer, unsigned int size);
+int host_close(int file);
+clock_t host_clock(void);
+
+#define open(name, flags)           host_open(name)
+#define read(file, buffer, size)    host_read(file, buffer, size)
+#define close(file)                 host_close(file)
+#define clock()                     host_clock()
+
+/****************************************************************************
+ ** SUPPORT FUNCTIONS
+ ****************************************************************************/
+
+// This function of the cc65 library is missing on the host.
+char* ultoa(unsigned long value, char* buffer, int radix);
+
+// This function is called by the trampolines (see tools/ovlstub.c) when
+// the function "name" of the module "module" returns: the module must be
+// still into its slot, otherwise the real target would have crashed.
+void host_check(unsigned char module, const char* name);
+
+#endif
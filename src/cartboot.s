@@ -0,0 +1,135 @@
+; /****************************************************************************
+;  * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+;  *                                                                          *
+;  * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+;  *--------------------------------------------------------------------------*
+;  * CARTRIDGE BOOT (FIRST BANK OF THE CARTRIDGE)                             *
+;  ****************************************************************************/
+
+; This is the code at the beginning of the first bank of the cartridge of
+; the "c64crt" target: it is linked alone (see cfg/c64-cartridge.cfg), and
+; the "ovlcart" tool puts the resident program and the modules after it.
+; At reset the KERNAL finds the signature and jumps here: the machine is
+; initialized as the KERNAL would do (but BASIC), and then the loader is
+; copied into the cassette buffer, since the code into the window changes
+; when another bank is shown.
+;
+; The loader reads the header that "ovlcart" writes right after this code
+; (the same description of a module used by cartridge.s, followed by the
+; address where the program starts), copies the program into the RAM, hides
+; the cartridge and starts the program. When the program ends, the machine
+; is reset: without the cartridge, BASIC starts.
+
+;------------------------------------------------------------------------------
+
+        .import     __LOADER_LOAD__, __LOADER_RUN__, __LOADER_SIZE__
+
+; Register of the cartridge: the number of the bank to show into the window,
+; or CART_OFF to hide the cartridge.
+BANK        = $DE00
+CART_OFF    = $80
+
+; First page of the window, and first page after it.
+WINDOW      = $80
+WINDOW_END  = $A0
+
+; KERNAL routines used at reset, and the part of the NMI handler that is
+; executed when no cartridge is present.
+IOINIT      = $FDA3
+RAMTAS      = $FD50
+RESTOR      = $FD15
+CINT        = $FF5B
+RESET       = $FCE2
+NMIEXIT     = $FE72
+
+; Zero page used by the loader (free for the user programs).
+source      = $FB
+destination = $FD
+
+; Size of the header: bank, page, address, size, start of the program.
+HEADER_SIZE = 8
+
+; The header follows this code into the first bank.
+header      = __LOADER_LOAD__ + __LOADER_SIZE__
+
+;------------------------------------------------------------------------------
+
+.segment "CODE"
+
+        .word   cold
+        .word   warm
+        .byte   $C3, $C2, $CD, $38, $30     ; "CBM80"
+
+cold:   jsr     IOINIT
+        jsr     RAMTAS
+        jsr     RESTOR
+        jsr     CINT
+        cli
+
+        ldx     #0
+copy:   lda     __LOADER_LOAD__,x
+        sta     __LOADER_RUN__,x
+        inx
+        cpx     #<__LOADER_SIZE__
+        bne     copy
+        jmp     __LOADER_RUN__
+
+; The RESTORE key is ignored while booting.
+
+warm:   jmp     NMIEXIT
+
+;------------------------------------------------------------------------------
+
+.segment "LOADER"
+
+loader: ldx     #HEADER_SIZE - 1
+read:   lda     header,x
+        sta     entry,x
+        dex
+        bpl     read
+
+        ldy     #0
+        sty     source
+        lda     entry+1
+        sta     source+1
+        lda     entry+2
+        sta     destination
+        lda     entry+3
+        sta     destination+1
+        lda     entry
+        sta     BANK
+        ldx     entry+5
+        beq     last
+
+page:   lda     (source),y
+        sta     (destination),y
+        iny
+        bne     page
+        inc     destination+1
+        inc     source+1
+        lda     source+1
+        cmp     #WINDOW_END
+        bne     next
+        lda     #WINDOW
+        sta     source+1
+        inc     entry
+        lda     entry
+        sta     BANK
+next:   dex
+        bne     page
+
+last:   cpy     entry+4
+        beq     done
+        lda     (source),y
+        sta     (destination),y
+        iny
+        bne     last
+
+done:   lda     #CART_OFF
+        sta     BANK
+        jsr     start
+        jmp     RESET
+
+start:  jmp     (entry+6)
+
+entry:  .res    HEADER_SIZE
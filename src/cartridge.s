@@ -0,0 +1,109 @@
+; /****************************************************************************
+;  * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+;  *                                                                          *
+;  * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+;  *--------------------------------------------------------------------------*
+;  * CARTRIDGE BANKS COPY (RESIDENT MODULE)                                   *
+;  ****************************************************************************/
+
+; The overlayed executable for cartridges (see the "c64crt" target of the
+; makefile) is written into the banks of a Magic Desk cartridge by the
+; "ovlcart" tool, together with the modules: the boot code (cartboot.s)
+; copies the resident program into the RAM, and then the cartridge is
+; hidden. This is the routine that brings a module into its slot: it shows
+; the bank where the module starts, it copies the module a page at a time
+; (going on into the next bank when the end of the window is reached) and
+; then it hides the cartridge again.
+;
+; While the cartridge is shown, its window ($8000-$9FFF) hides the RAM for
+; reading, but the writes go to the RAM: so the module can be copied there
+; too. This code and its variables must stay below the window: the routine
+; is placed into the LOWCODE segment, at the beginning of the program, and
+; it uses only the zero page.
+
+.if .defined(__C64__) .and .defined(__CARTRIDGE__)
+
+        .export     _cartridge_load
+        .importzp   ptr1, ptr2, tmp1, tmp2
+
+;------------------------------------------------------------------------------
+
+; Register of the cartridge: the number of the bank to show into the window,
+; or CART_OFF to hide the cartridge.
+BANK        = $DE00
+CART_OFF    = $80
+
+; First page of the window, and first page after it.
+WINDOW      = $80
+WINDOW_END  = $A0
+
+;------------------------------------------------------------------------------
+
+.segment "LOWCODE"
+
+; void cartridge_load(const overlay_bank* module);
+;
+; Copy the module described by "module" (see overlay_bank into main.h): the
+; bank and the page where it starts, the address where it is copied and its
+; size. The first byte of the module is at the beginning of the page.
+
+_cartridge_load:
+        sta     ptr1
+        stx     ptr1+1
+        ldy     #0
+        lda     (ptr1),y
+        sta     tmp1
+        iny
+        lda     (ptr1),y
+        pha
+        iny
+        lda     (ptr1),y
+        sta     ptr2
+        iny
+        lda     (ptr1),y
+        sta     ptr2+1
+        iny
+        lda     (ptr1),y
+        sta     tmp2
+        iny
+        lda     (ptr1),y
+        tax
+        pla
+        sta     ptr1+1
+        ldy     #0
+        sty     ptr1
+
+        lda     tmp1
+        sta     BANK
+        cpx     #0
+        beq     last
+
+page:   lda     (ptr1),y
+        sta     (ptr2),y
+        iny
+        bne     page
+        inc     ptr2+1
+        inc     ptr1+1
+        lda     ptr1+1
+        cmp     #WINDOW_END
+        bne     next
+        lda     #WINDOW
+        sta     ptr1+1
+        inc     tmp1
+        lda     tmp1
+        sta     BANK
+next:   dex
+        bne     page
+
+last:   cpy     tmp2
+        beq     done
+        lda     (ptr1),y
+        sta     (ptr2),y
+        iny
+        bne     last
+
+done:   lda     #CART_OFF
+        sta     BANK
+        rts
+
+.endif
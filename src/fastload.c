@@ -0,0 +1,243 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * 1541 FAST-LOADER (RESIDENT MODULE)                                       *
+ ****************************************************************************/
+
+/****************************************************************************
+ ** INCLUDE SECTION
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <cc65.h>
+
+#include "main.h"
+
+// The fast-loader is available only for the overlayed executables on
+// Commodore targets, and only if it has been enabled at compile time by
+// defining the __FASTLOAD__ symbol (see the makefile). Otherwise, the
+// overlay manager will use the standard KERNAL routines.
+
+#if defined(__OVERLAY__) && defined(__CBM__) && defined(__FASTLOAD__)
+
+#include <cbm.h>
+#include <device.h>
+
+/****************************************************************************
+ ** DEFINITIONS SECTION
+ ****************************************************************************/
+
+// Commands understood by the drive code.
+#define FASTLOAD_QUIT           0
+#define FASTLOAD_LOAD           1
+#define FASTLOAD_DIRECT         2
+
+// Number of bytes sent with a single "M-W" command.
+#define FASTLOAD_CHUNK          32
+
+// Length of a file name into the directory.
+#define FASTLOAD_NAME           16
+
+// Characters of the "M-W" (memory write) and "M-E" (memory execute) DOS
+// commands, as numbers: they must not be translated into PETSCII.
+#define DOS_M                   0x4d
+#define DOS_MINUS               0x2d
+#define DOS_W                   0x57
+#define DOS_E                   0x45
+
+/****************************************************************************
+ ** UPLOAD SECTION
+ ****************************************************************************/
+
+// This code is needed only once, at startup: so we put it into the ONCE
+// segment, that will be reused by the program.
+
+#pragma code-name (push, "ONCE")
+
+/**
+ * This function sends a command to the command channel of the drive by
+ * using directly the serial bus routines of the KERNAL (without opening a
+ * file, since a close would talk with the drive once the drive code is
+ * running). It returns 0 if the drive is not present.
+ */
+static unsigned char fastload_command(unsigned char device, unsigned char* command, unsigned char length)
+{
+    unsigned char i;
+
+    cbm_k_listen(device);
+    if (cbm_k_readst() & 0x80) {
+        cbm_k_unlsn();
+        return 0;
+    }
+    cbm_k_second(0x6f);
+    for (i = 0; i < length; ++i) {
+        cbm_k_ciout(command[i]);
+    }
+    cbm_k_unlsn();
+    return 1;
+}
+
+/**
+ * This function uploads the drive code into the 1541, starts it and waits
+ * for it to be ready. It is called by the constructor of the module at
+ * startup: if anything goes wrong, fastload_active stays at zero and the
+ * overlay manager will use the KERNAL routines.
+ */
+void fastload_install(void)
+{
+    // Note that this buffer must not be static: the BSS segment could
+    // overlap the ONCE segment, and it will be cleared after constructors.
+    unsigned char command[6 + FASTLOAD_CHUNK];
+    unsigned char device = getcurrentdevice();
+    unsigned int address = 0x0500;
+    unsigned int done = 0;
+    unsigned char length;
+    unsigned char i;
+
+    while (done < fastload_drive_size) {
+        length = (fastload_drive_size - done) > FASTLOAD_CHUNK ? FASTLOAD_CHUNK : (fastload_drive_size - done);
+        command[0] = DOS_M; command[1] = DOS_MINUS; command[2] = DOS_W;
+        command[3] = (unsigned char)address;
+        command[4] = (unsigned char)(address >> 8);
+        command[5] = length;
+        for (i = 0; i < length; ++i) {
+            command[6 + i] = fastload_drive_code[done + i];
+        }
+        if (!fastload_command(device, command, 6 + length)) {
+            return;
+        }
+        address += length;
+        done += length;
+    }
+
+    command[0] = DOS_M; command[1] = DOS_MINUS; command[2] = DOS_E;
+    command[3] = (unsigned char)fastload_drive_start;
+    command[4] = (unsigned char)(fastload_drive_start >> 8);
+    if (!fastload_command(device, command, 5)) {
+        return;
+    }
+
+    fastload_active = fastload_ready();
+}
+
+#pragma code-name (pop)
+
+/****************************************************************************
+ ** LOADING SECTION
+ ****************************************************************************/
+
+/**
+ * This function asks the drive code to send the file named "name". The
+ * bytes can then be read by calling fastload_getc(), until it returns -1.
+ * It returns 0 if the drive did not answer.
+ */
+unsigned char fastload_open(char* name)
+{
+    unsigned char i;
+
+    if (!fastload_ready()) {
+        return 0;
+    }
+
+    fastload_putc(FASTLOAD_LOAD);
+    for (i = 0; i < FASTLOAD_NAME; ++i) {
+        if (*name) {
+            fastload_putc(*name++);
+        } else {
+            fastload_putc(0xa0);
+        }
+    }
+    return 1;
+}
+
+/**
+ * This function asks the drive code to send the file that starts at
+ * "track" and "sector", without looking for it into the directory. The
+ * bytes can then be read by calling fastload_getc(), until it returns -1.
+ * It returns 0 if the drive did not answer.
+ */
+unsigned char fastload_open_direct(unsigned char track, unsigned char sector)
+{
+    if (!fastload_ready()) {
+        return 0;
+    }
+
+    fastload_putc(FASTLOAD_DIRECT);
+    fastload_putc(track);
+    fastload_putc(sector);
+    return 1;
+}
+
+/**
+ * This function receives the file that has been opened into the address
+ * present in its first two bytes, exactly as cbm_load() does.
+ * It returns 0 if any error occours.
+ */
+static unsigned char fastload_receive(void)
+{
+    unsigned char* address;
+    #ifdef __OVERLAY_STATS__
+    unsigned char* start;
+    #endif
+    int c;
+
+    address = (unsigned char*)fastload_getc();
+    address += fastload_getc() << 8;
+    if (fastload_status != FASTLOAD_OK) {
+        return 0;
+    }
+
+    #ifdef __OVERLAY_STATS__
+    start = address;
+    #endif
+    while ((c = fastload_getc()) >= 0) {
+        *address++ = (unsigned char)c;
+    }
+    #ifdef __OVERLAY_STATS__
+    overlay_transferred = address - start + 2;
+    #endif
+
+    return (fastload_status == FASTLOAD_EOF);
+}
+
+/**
+ * This function loads the file named "name" into the address present in
+ * its first two bytes.
+ * It returns 0 if any error occours.
+ */
+unsigned char fastload_load(char* name)
+{
+    if (!fastload_open(name)) {
+        return 0;
+    }
+    return fastload_receive();
+}
+
+/**
+ * This function loads the file that starts at "track" and "sector" into
+ * the address present in its first two bytes.
+ * It returns 0 if any error occours.
+ */
+unsigned char fastload_load_direct(unsigned char track, unsigned char sector)
+{
+    if (!fastload_open_direct(track, sector)) {
+        return 0;
+    }
+    return fastload_receive();
+}
+
+/**
+ * This function gives back the control of the drive to the DOS, so that the
+ * standard KERNAL routines can be used again.
+ */
+void fastload_exit(void)
+{
+    if (fastload_active && fastload_ready()) {
+        fastload_putc(FASTLOAD_QUIT);
+    }
+    fastload_active = 0;
+}
+
+#endif
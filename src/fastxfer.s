@@ -0,0 +1,565 @@
+; /****************************************************************************
+;  * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+;  *                                                                          *
+;  * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+;  *--------------------------------------------------------------------------*
+;  * 1541 FAST-LOADER (RESIDENT MODULE)                                       *
+;  ****************************************************************************/
+
+; The fast-loader is made of two parts (the C part, in fastload.c, takes
+; care of the upload and of the commands): a small program that is uploaded
+; into the RAM of the 1541 at startup (and that keeps the control of the
+; drive from then on) and the routines that, on the computer, exchange
+; bytes with it. Both CLK and DATA lines are used to move two bits at a
+; time, while the ATN line is used by the computer as a "strobe": every
+; time it is toggled, the drive puts the next two bits on the lines (or it
+; reads the next two bits from them).
+;
+; Since the drive reacts to the toggle in a bounded time, the computer has
+; only to wait a "minimum" time before sampling the lines: badlines and
+; interrupts can only make it slower, never wrong. This is why the same
+; code works on both C=64 and VIC 20, PAL or NTSC.
+;
+; Note that the ATN line is used outside of the standard protocol, so no
+; other device must be active on the serial bus while loading.
+;
+; The protocol is the following:
+;
+;   - when the drive is ready (to receive a command, or to send a block),
+;     it pulls DATA low;
+;   - a command is made by a byte (0 = quit, 1 = load by name, 2 = load
+;     by position) followed by the name of the file (16 bytes, padded with
+;     $A0) or by the track and the sector of its first block;
+;   - the file is sent block by block: a byte with the number of bytes
+;     (1...254) followed by the bytes themselves; 0 means "end of file"
+;     and $FF means "error"; after every block the computer toggles ATN
+;     once more, to acknowledge it;
+;   - at the end of a command, the ATN line is always released.
+
+.ifdef __FASTLOAD__
+
+        .export     _fastload_active
+        .export     _fastload_ready
+        .export     _fastload_putc
+        .export     _fastload_getc
+        .export     _fastload_status
+        .export     _fastload_drive_code
+        .export     _fastload_drive_size
+        .export     _fastload_drive_start
+
+        .import     _fastload_install
+
+;------------------------------------------------------------------------------
+; HOST DEFINITIONS
+;------------------------------------------------------------------------------
+
+.ifdef __C64__
+
+; CIA 2 port A: bit 3 = ATN OUT, bit 4 = CLK OUT, bit 5 = DATA OUT (1 = low),
+; bit 6 = CLK IN, bit 7 = DATA IN (1 = high).
+PORT        = $DD00
+ATNOUT      = $08
+CLKOUT      = $10
+DATAOUT     = $20
+
+.else
+
+; VIA 1 port A: bit 0 = CLK IN, bit 1 = DATA IN (1 = high), bit 7 = ATN OUT;
+; VIA 2 PCR: bit 1 = CLK OUT, bit 5 = DATA OUT (1 = low).
+PORT        = $911F
+PCR         = $912C
+ATNOUT      = $80
+CLKOUT      = $02
+DATAOUT     = $20
+
+.endif
+
+; Number of iterations of the delay loop after each toggle of ATN (about 5
+; cycles each): it must be longer than the worst reaction time of the drive.
+DELAY       = 9
+
+; Status of the last transfer.
+STATUS_OK       = 0
+STATUS_EOF      = 1
+STATUS_ERROR    = 2
+
+;------------------------------------------------------------------------------
+; HOST VARIABLES
+;------------------------------------------------------------------------------
+
+; These variables must be in the DATA segment: they are used by the
+; constructor, that runs before the BSS is cleared, and the BSS could
+; overlap the ONCE segment where the constructor itself lives.
+
+.segment "DATA"
+
+_fastload_active:   .byte   0
+_fastload_status:   .byte   0
+port:               .byte   0
+value:              .byte   0
+lines:              .byte   0
+remaining:          .byte   0
+started:            .byte   0
+
+;------------------------------------------------------------------------------
+; HOST ROUTINES
+;------------------------------------------------------------------------------
+
+.segment "CODE"
+
+; Toggle the ATN line, and wait for the drive to react.
+
+toggle: lda     port
+        eor     #ATNOUT
+        sta     port
+        sta     PORT
+wait:   ldx     #DELAY
+@loop:  dex
+        bne     @loop
+        rts
+
+; Wait for the drive to pull DATA low (ready).
+
+ready:
+.ifdef __C64__
+        bit     PORT
+        bmi     ready
+.else
+        lda     PORT
+        and     #$02
+        bne     ready
+.endif
+        rts
+
+; Receive a byte from the drive into A.
+
+getbyte:
+        ldy     #4
+@pair:  jsr     toggle
+        lda     PORT
+.ifdef __C64__
+        asl
+        ror     value
+        asl
+        ror     value
+.else
+        ror
+        ror
+        ror     value
+        asl
+        ror     value
+.endif
+        dey
+        bne     @pair
+        lda     value
+        rts
+
+; Make sure that ATN is released, at the end of a command.
+
+normalize:
+        lda     port
+        and     #ATNOUT
+        beq     @done
+        jsr     toggle
+@done:  rts
+
+; unsigned char fastload_ready(void);
+;
+; Wait (for about half a second at most) for the drive to be ready to
+; receive a command. It returns 0 if the drive did not answer.
+
+_fastload_ready:
+.ifdef __C64__
+        lda     PORT
+        and     #$07
+        sta     port
+        sta     PORT
+.else
+        lda     PORT
+        and     #<~ATNOUT
+        sta     port
+        sta     PORT
+        lda     PCR
+        and     #<~(CLKOUT | DATAOUT)
+        sta     PCR
+.endif
+        lda     #0
+        sta     started
+        sta     remaining
+        sta     _fastload_status
+        tay
+        ldx     #0
+@loop:
+.ifdef __C64__
+        bit     PORT
+        bpl     @ok
+.else
+        lda     PORT
+        and     #$02
+        beq     @ok
+.endif
+        dex
+        bne     @loop
+        dey
+        bne     @loop
+        lda     #0
+        tax
+        rts
+@ok:    lda     #1
+        ldx     #0
+        rts
+
+; void __fastcall__ fastload_putc(unsigned char c);
+;
+; Send a byte to the drive: the two bits are put on the lines together with
+; the toggle of ATN, and they are kept there until the drive has read them.
+
+_fastload_putc:
+        sta     value
+        ldy     #4
+@pair:
+.ifdef __C64__
+        lda     #0
+        lsr     value
+        bcc     @clk
+        ora     #DATAOUT
+@clk:   lsr     value
+        bcc     @set
+        ora     #CLKOUT
+@set:   sta     lines
+        lda     port
+        eor     #ATNOUT
+        sta     port
+        ora     lines
+        sta     PORT
+        jsr     wait
+.else
+        lda     PCR
+        and     #<~(CLKOUT | DATAOUT)
+        lsr     value
+        bcc     @clk
+        ora     #DATAOUT
+@clk:   lsr     value
+        bcc     @set
+        ora     #CLKOUT
+@set:   sta     PCR
+        jsr     toggle
+.endif
+        dey
+        bne     @pair
+.ifdef __C64__
+        lda     port
+        sta     PORT
+.else
+        lda     PCR
+        and     #<~(CLKOUT | DATAOUT)
+        sta     PCR
+.endif
+        rts
+
+; int fastload_getc(void);
+;
+; Receive the next byte of the file that is being loaded. It returns -1 at
+; the end of the file (or if an error occurred: see fastload_status).
+
+_fastload_getc:
+        lda     remaining
+        bne     @byte
+        lda     _fastload_status
+        bne     @end
+        lda     started
+        beq     @first
+        jsr     toggle          ; acknowledge the previous block
+@first: lda     #1
+        sta     started
+        jsr     ready
+        jsr     getbyte
+        beq     @eof
+        cmp     #$ff
+        beq     @error
+        sta     remaining
+@byte:  dec     remaining
+        jsr     getbyte
+        ldx     #0
+        rts
+@error: lda     #STATUS_ERROR
+        .byte   $2c
+@eof:   lda     #STATUS_EOF
+        sta     _fastload_status
+        jsr     toggle          ; acknowledge the last block
+        jsr     normalize
+@end:   lda     #$ff
+        tax
+        rts
+
+;------------------------------------------------------------------------------
+; DRIVE CODE
+;------------------------------------------------------------------------------
+
+; This code is assembled to be executed at $0500 into the 1541, and it is
+; needed only at startup: so it is put into the ONCE segment.
+
+.segment "ONCE"
+
+; The constructor uploads the drive code, if the loader is enabled.
+
+fastinit:
+        jmp     _fastload_install
+
+        .constructor fastinit
+
+_fastload_drive_size:
+        .word   drive_end - drive_begin
+
+_fastload_drive_start:
+        .word   dstart
+
+_fastload_drive_code:
+
+drive_begin:
+
+.org $0500
+
+; 1541 registers and locations used by the drive code.
+
+VIA1PB      = $1800             ; serial port (see below)
+VIA1IER     = $180E             ; VIA 1 interrupt enable register
+JOB0        = $00               ; job code for buffer 0
+JOB0TRACK   = $06               ; track for buffer 0
+JOB0SECTOR  = $07               ; sector for buffer 0
+BUFFER0     = $0300             ; buffer 0
+
+; VIA 1 port B: bit 0 = DATA IN, bit 2 = CLK IN (1 = low), bit 1 = DATA OUT,
+; bit 3 = CLK OUT (1 = low), bit 4 = ATN acknowledge, bit 7 = ATN IN.
+
+dstart: sei
+        lda     #$02
+        sta     VIA1IER         ; no more interrupts from ATN
+        lda     #$80
+        sta     datn
+        lda     #$10
+        sta     datna
+
+; Wait for a command.
+
+command:
+        lda     #$02            ; DATA low: ready
+        sta     VIA1PB
+        jsr     dgetbyte
+        bne     @load
+        jmp     quit
+@load:  cmp     #$02
+        beq     direct
+        cmp     #$01
+        bne     error
+        ldy     #0
+@name:  jsr     dgetbyte
+        sta     dfname,y
+        iny
+        cpy     #16
+        bne     @name
+        jsr     find
+        bcs     error
+        bcc     block
+
+; The position of the file is already known: no directory search is needed.
+
+direct: jsr     dgetbyte
+        sta     JOB0TRACK
+        jsr     dgetbyte
+        sta     JOB0SECTOR
+
+; Send the file, block by block.
+
+block:  jsr     readsector
+        bcs     error
+        ldx     #254
+        lda     BUFFER0
+        bne     @full
+        ldx     BUFFER0+1
+        dex
+        beq     eof
+@full:  stx     dcount
+        jsr     dready
+        lda     dcount
+        jsr     dsendbyte
+        lda     #2
+        sta     dindex
+@data:  ldy     dindex
+        lda     BUFFER0,y
+        jsr     dsendbyte
+        inc     dindex
+        dec     dcount
+        bne     @data
+        jsr     dack
+        lda     BUFFER0
+        beq     eof
+        sta     JOB0TRACK
+        lda     BUFFER0+1
+        sta     JOB0SECTOR
+        jmp     block
+
+eof:    lda     #$00
+        .byte   $2c
+error:  lda     #$ff
+        pha
+        jsr     dready
+        pla
+        jsr     dsendbyte
+        jsr     dack
+        lda     datn             ; if ATN is still asserted, wait for the
+        bmi     command         ; computer to release it
+        ldx     datna
+        jsr     dwait
+        jmp     command
+
+; Give back the drive to the DOS.
+
+quit:   lda     #$00
+        sta     VIA1PB
+        lda     #$82
+        sta     VIA1IER
+        cli
+        rts
+
+; Search the file named "dfname" into the directory. It returns C = 1 if
+; not found, otherwise the first track / sector are ready for the read job.
+
+find:   lda     #18
+        sta     JOB0TRACK
+        lda     #1
+        sta     JOB0SECTOR
+@sect:  jsr     readsector
+        bcs     @not
+        ldx     #0
+@entry: lda     BUFFER0+2,x
+        beq     @next
+        stx     dentry
+        ldy     #0
+@cmp:   lda     BUFFER0+5,x
+        cmp     dfname,y
+        bne     @diff
+        inx
+        iny
+        cpy     #16
+        bne     @cmp
+        ldx     dentry
+        lda     BUFFER0+3,x
+        sta     JOB0TRACK
+        lda     BUFFER0+4,x
+        sta     JOB0SECTOR
+        clc
+        rts
+@diff:  ldx     dentry
+@next:  txa
+        clc
+        adc     #32
+        tax
+        bne     @entry
+        lda     BUFFER0
+        beq     @not
+        sta     JOB0TRACK
+        lda     BUFFER0+1
+        sta     JOB0SECTOR
+        jmp     @sect
+@not:   sec
+        rts
+
+; Read a sector into buffer 0 by using the job queue of the DOS (that works
+; under interrupt). It returns C = 1 on error.
+
+readsector:
+        lda     #$80
+        sta     JOB0
+        cli
+@wait:  lda     JOB0
+        bmi     @wait
+        sei
+        cmp     #$02
+        rts
+
+; Wait for the computer to toggle ATN, then store X into the port.
+
+dwait:  lda     VIA1PB
+        eor     datn
+        bmi     dwait
+        stx     VIA1PB
+        lda     datn
+        eor     #$80
+        sta     datn
+        lda     datna
+        eor     #$10
+        sta     datna
+        rts
+
+; Pull DATA low, to signal that a block is ready.
+
+dready: lda     datna
+        eor     #$10
+        ora     #$02
+        sta     VIA1PB
+        rts
+
+; Acknowledge: release the lines at the next toggle.
+
+dack:   ldx     datna
+        jmp     dwait
+
+; Receive a byte from the computer into A.
+
+dgetbyte:
+        lda     #4
+        sta     dpairs
+@pair:  ldx     datna
+        jsr     dwait
+        nop
+        lda     VIA1PB
+        lsr
+        ror     dvalue
+        lsr
+        lsr
+        ror     dvalue
+        dec     dpairs
+        bne     @pair
+        lda     dvalue
+        rts
+
+; Send the byte into A to the computer (inverted, since a low line is read
+; as 0 by the computer).
+
+dsendbyte:
+        eor     #$ff
+        sta     dvalue
+        lda     #4
+        sta     dpairs
+@pair:  lda     dvalue
+        and     #$03
+        tax
+        lda     encode,x
+        ora     datna
+        tax
+        lsr     dvalue
+        lsr     dvalue
+        jsr     dwait
+        dec     dpairs
+        bne     @pair
+        rts
+
+encode: .byte   $00, $02, $08, $0A
+
+; Drive variables.
+
+datn:    .byte   0               ; next state of ATN we are waiting for
+datna:   .byte   0               ; ATN acknowledge bit for that state
+dvalue:  .byte   0
+dpairs:  .byte   0
+dcount:  .byte   0
+dindex:  .byte   0
+dentry:  .byte   0
+dfname:  .res    16
+
+.reloc
+
+drive_end:
+
+.endif
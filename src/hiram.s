@@ -0,0 +1,107 @@
+; /****************************************************************************
+;  * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+;  *                                                                          *
+;  * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+;  *--------------------------------------------------------------------------*
+;  * HIDDEN RAM COPY (RESIDENT MODULE)                                        *
+;  ****************************************************************************/
+
+; On the C=64 there are 12K of RAM "hidden" under the I/O area and the KERNAL
+; ROM ($D000-$FFFF), that the program does not use. The overlay manager uses
+; them as a cache for the modules already loaded (see overlay.c): this is
+; the routine that moves the modules between the slots and the cache.
+;
+; In order to see the hidden RAM, all the ROMs and the I/O area must be
+; banked out: so interrupts are disabled during the copy, and the NMI vector
+; (into the hidden RAM) points to an "rti" in the meanwhile. Note that a NMI
+; coming from the CIA 2 will not be acknowledged, and so it will be lost.
+
+.if .defined(__C64__) .and .defined(__HIRAM__)
+
+        .export     _hiram_copy
+        .import     popax
+
+;------------------------------------------------------------------------------
+
+; Processor port: the value that banks out all the ROMs and the I/O area.
+PROCPORT    = $01
+ALLRAM      = $34
+
+; NMI vector, as seen when the KERNAL ROM is banked out.
+NMIVEC      = $FFFA
+
+;------------------------------------------------------------------------------
+
+.segment "BSS"
+
+pages:  .res    1
+
+;------------------------------------------------------------------------------
+
+.segment "CODE"
+
+; void hiram_copy(void* destination, void* source, unsigned char pages);
+;
+; Copy "pages" pages (of 256 bytes) from "source" to "destination". Both the
+; addresses must be aligned to a page, and "pages" must not be zero. The
+; copy is unrolled four times: the addresses of the instructions are changed
+; while copying.
+
+_hiram_copy:
+        sta     pages
+        jsr     popax
+        stx     load0+2
+        stx     load1+2
+        stx     load2+2
+        stx     load3+2
+        jsr     popax
+        stx     store0+2
+        stx     store1+2
+        stx     store2+2
+        stx     store3+2
+
+        php
+        sei
+        lda     PROCPORT
+        pha
+        lda     #ALLRAM
+        sta     PROCPORT
+        lda     #<nmi
+        sta     NMIVEC
+        lda     #>nmi
+        sta     NMIVEC+1
+
+page:   ldy     #$3F
+loop:
+load0:  lda     $FF00,y
+store0: sta     $FF00,y
+load1:  lda     $FF40,y
+store1: sta     $FF40,y
+load2:  lda     $FF80,y
+store2: sta     $FF80,y
+load3:  lda     $FFC0,y
+store3: sta     $FFC0,y
+        dey
+        bpl     loop
+
+        inc     load0+2
+        inc     load1+2
+        inc     load2+2
+        inc     load3+2
+        inc     store0+2
+        inc     store1+2
+        inc     store2+2
+        inc     store3+2
+        dec     pages
+        bne     page
+
+        pla
+        sta     PROCPORT
+        plp
+        rts
+
+; A NMI during the copy is simply ignored.
+
+nmi:    rti
+
+.endif
@@ -11,84 +11,11 @@
  ****************************************************************************/
 
 #include <stdio.h>
+#include <conio.h>
 #include <cc65.h>
 
 #include "main.h"
 
-// Overlay management is driven by the definition of the appropriate 
-// compilation symbol (__OVERLAY__). In this case, we enable or disable the 
-// compilation of the relevant code.
-
-#ifdef __OVERLAY__
-
-    /************************************************************************
-     ** OVERLAY MANAGEMENT SECTION
-     ************************************************************************/
-
-    // We differentiate management if we are with a Commodore system or not. 
-    // The difference lies in the fact that, in the case of "commodore" 
-    // (__CBM__) targets, we take advantage of the fact that the binaries 
-    // produced contain, at the beginning of the file, the starting position 
-    // where to load the code.
-
-    #ifndef __CBM__
-
-        //-------------------------------------------------------------------
-        // GENERAL OVERLAY MANAGEMENT
-        //-------------------------------------------------------------------
-
-        #include <fcntl.h>
-        #include <unistd.h>
-
-        /**
-         * This function loads a module (code / data) named "module_name" 
-         * from the mass storage into memory. The module will be loaded 
-         * starting from address "overlay_address" for a length of 
-         * overlay_size bytes.
-         * It returns 0 if any error occours, and print out an error message.
-         */
-        unsigned char load_overlay(char* module_name, void* overlay_address, void* overlay_size)
-        {
-            int f = open(module_name, O_RDONLY);
-            if (f == -1) {
-                puts("Internal error - errore interno.");
-                return 0;
-            }
-            read(f, overlay_address, (unsigned)overlay_size);
-            close(f);
-            return 1;
-        }
-
-    #else
-
-        //-------------------------------------------------------------------
-        // COMMODORE OVERLAY MANAGEMENT
-        //-------------------------------------------------------------------
-
-        #include <cbm.h>
-        #include <device.h>
-
-        /**
-         * This function loads a module (code / data) named "module_name" 
-         * from the mass storage into the address present in the header of 
-         * the binary file. 
-         * It returns 0 if any error occours, and print out an error message.
-         */
-        unsigned char load_overlay(char* module_name, void* overlay_address, void* overlay_size)
-        {
-            // Ignore overlay_address and overlay_size parameters
-            (void)overlay_address; (void)overlay_size;
-            if (cbm_load(module_name, getcurrentdevice(), NULL) == 0) {
-                puts("Internal error - errore interno.");
-                return 0;
-            }
-            return 1;
-        }
-
-    #endif
-
-#endif
-
 /****************************************************************************
  ** RESIDENT VARIABLES SECTION
  ****************************************************************************/
@@ -113,16 +40,100 @@ int canto = 0;
  * This function print out the title of a "canto".
  */
 void write_title(char* title) {
+    #if defined(__CBM__) && defined(__SCREEN__)
+    screen_clear();
+    #else
     int i = 0;
     for (i = 0; i < 25; ++i) puts("");
-    puts(title);
+    #endif
+    write_line(title);
+}
+
+#ifdef __PACKTEXT__
+
+/**
+ * This function print out a single verse, by expanding the entries of the 
+ * dictionary (see tools/ovltext.c). It returns the position of the next 
+ * verse.
+ */
+static const unsigned char* expand_verse(const unsigned char* text) {
+    static char line[TEXT_LINE + 1];
+    unsigned char length = 0;
+    unsigned char c;
+    unsigned char i;
+    unsigned char end;
+
+    while ((c = *text++) != 0) {
+        if (c == TEXT_ESCAPE) {
+            line[length++] = *text++;
+        } else if (c >= TEXT_TOKEN && c < TEXT_ESCAPE) {
+            c -= TEXT_TOKEN;
+            end = text_offsets[c + 1];
+            for (i = text_offsets[c]; i < end; ++i) {
+                line[length++] = text_dictionary[i];
+            }
+        } else {
+            line[length++] = c;
+        }
+    }
+    line[length] = 0;
+    write_line(line);
+    return text;
 }
 
 /**
  * This function print out a single verse of a "canto".
  */
 void write_verse(char* verse) {
-    puts(verse);
+    expand_verse((unsigned char*)verse);
+}
+
+/**
+ * This function print out the text of a "canto" in the chosen language, 
+ * that is the only content of the module "module" (if overlayed).
+ */
+void write_text(unsigned char module, const unsigned char* text) {
+    #ifdef __OVERLAY__
+    if (!require_overlay(module)) {
+        return;
+    }
+    #ifdef __RELOCATE__
+    // The text has been placed wherever there was room (see ovlreloc.c).
+    text = overlay_base;
+    #endif
+    #endif
+    while (*text != TEXT_END) {
+        if (*text == TEXT_PAUSE) {
+            press_any_key();
+            ++text;
+        } else {
+            text = expand_verse(text);
+        }
+    }
+}
+
+#else
+
+/**
+ * This function print out a single verse of a "canto".
+ */
+void write_verse(char* verse) {
+    write_line(verse);
+}
+
+#endif
+
+/**
+ * This function wait a keypress, and it returns the key. Meanwhile, the 
+ * overlay manager can load the modules asked for in the background.
+ */
+int wait_key(void) {
+    while (!kbhit()) {
+        #if defined(__OVERLAY__) && defined(__PREFETCH__)
+        overlay_idle();
+        #endif
+    }
+    return cgetc();
 }
 
 /**
@@ -130,11 +141,11 @@ void write_verse(char* verse) {
  */
 void press_any_key() {
     if (language == 0) {
-        puts("Premi un tasto per continuare");
+        write_line("Premi un tasto per continuare");
     } else {
-        puts("Press any key to continue");
+        write_line("Press any key to continue");
     }
-    getchar();
+    wait_key();
 }
 
 /****************************************************************************
@@ -142,46 +153,42 @@ void press_any_key() {
  ****************************************************************************/
 
 // This is the main function body. The purpose is to call the various 
-// functions present in the modules, taking care to load the relevant 
-// code / data into memory(in the "overlay" area).
+// functions present in the modules. There is no need to take care of 
+// loading the relevant code / data into memory (in the "overlay" area): 
+// each overlayed function is reached through a resident "trampoline" that 
+// asks the overlay manager to load the module, if it is not yet there.
 
 void main(void) {
 
+    #if defined(__OVERLAY__) && defined(__OVERLAY_STACK__)
+    // The free memory below the stack is painted, to measure its use.
+    overlay_stack_paint();
+    #endif
+
+    #if defined(__OVERLAY__) && defined(__VIC20__) && defined(__VICRAM__)
+    // The memory expansions (if any) will keep the modules.
+    overlay_probe();
+    #endif
+
     // Main loop
 
     do {
 
         // presentation() and choose_language() are both defined into
-        // the third module ("demo.3"): so we are going to load it before 
-        // calling any of them.
+        // the third module ("demo.3").
 
-        #ifdef __OVERLAY__
-        if (load_overlay("demo.3", _OVERLAY3_LOAD__, _OVERLAY3_SIZE__)) {
-        #endif
-
-            // Present the program.
-            presentation();
+        // Present the program.
+        presentation();
 
-            // Ask the user for the language
-            choose_language();
-
-        #ifdef __OVERLAY__
-        }
-        #endif
+        // Ask the user for the language
+        choose_language();
 
         // Canto's loop.
         do {
 
-            // choose_canto() is defined into the fourth module ("demo.4"):
-            // so we are going to load it before calling it.
+            // choose_canto() is defined into the fourth module ("demo.4").
 
-            #ifdef __OVERLAY__
-            if (load_overlay("demo.4", _OVERLAY3_LOAD__, _OVERLAY3_SIZE__)) {
-            #endif
-                choose_canto();
-            #ifdef __OVERLAY__
-            }
-            #endif
+            choose_canto();
 
             // According to the selected "canto"...
 
@@ -190,38 +197,31 @@ void main(void) {
                 // CANTO I
                 case 1:
 
-                    // canto1() is defined into the first module ("demo.1"):
-                    // so we are going to load it before calling it.
-
-                    #ifdef __OVERLAY__
-                    if (load_overlay("demo.1", _OVERLAY3_LOAD__, 
-                                                        _OVERLAY3_SIZE__)) {
-                    #endif
-                        canto1();
-                    #ifdef __OVERLAY__
-                    }
-                    #endif
+                    // canto1() is defined into the first module ("demo.1").
+
+                    canto1();
                     break;
 
                 // CANTO II
                 case 2:
 
-                    // canto2() is defined into the first module ("demo.1"):
-                    // so we are going to load it before calling it.
-
-                    #ifdef __OVERLAY__
-                    if (load_overlay("demo.2", _OVERLAY3_LOAD__, 
-                                                        _OVERLAY3_SIZE__)) {
-                    #endif
-                        canto2();
-                    #ifdef __OVERLAY__
-                    }
-                    #endif
+                    // canto2() is defined into the second module ("demo.2").
 
+                    canto2();
                     break;
             }
         } while (canto != 0); // Repeat until a quit is chosen
 
+        #if defined(__OVERLAY__) && defined(__OVERLAY_STATS__) && defined(__CBM__)
+        // When the user quits, the counters of the overlay manager are 
+        // written into the "demo.stats" file on the disk.
+        #ifdef __OVERLAY_BENCH__
+        overlay_bench_exit(overlay_save());
+        #else
+        overlay_save();
+        #endif
+        #endif
+
     } while (1); // Repeat forever
 
 }
\ No newline at end of file
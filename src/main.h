@@ -14,14 +14,362 @@
 
     // These variables are defined by the linker, and allow to identify the 
     // address where to store the pieces of codeand data loaded from the 
-    // mass memories.
+    // mass memories. The native build (__HOST__) has no such linker: they 
+    // are given by its shim, that simulates the overlay area (see the host 
+    // directory).
+    #ifdef __HOST__
+    #include "host.h"
+    #else
     extern void _OVERLAY1_LOAD__[], _OVERLAY1_SIZE__[];
     extern void _OVERLAY2_LOAD__[], _OVERLAY2_SIZE__[];
     extern void _OVERLAY3_LOAD__[], _OVERLAY3_SIZE__[];
     extern void _OVERLAY4_LOAD__[], _OVERLAY4_SIZE__[];
+    extern void _OVERLAY5_LOAD__[], _OVERLAY5_SIZE__[];
+    extern void _OVERLAY6_LOAD__[], _OVERLAY6_SIZE__[];
+    extern void _OVERLAY7_LOAD__[], _OVERLAY7_SIZE__[];
+    extern void _OVERLAY8_LOAD__[], _OVERLAY8_SIZE__[];
+    #endif
 
-    unsigned char load_overlay(char* module_name, void* overlay_address, 
-                                                        void* overlay_size);
+    unsigned char load_overlay(unsigned char module);
+
+    // Number of modules that can be "overlayed". Modules are identified by 
+    // a number, starting from 1 (0 means "no module"). When the verses are 
+    // compressed, the modules from 5 to 8 hold the text of each "canto" in 
+    // each language (see tools/ovltext.c).
+    #ifdef __PACKTEXT__
+        #define OVERLAY_MODULES 8
+    #else
+        #define OVERLAY_MODULES 4
+    #endif
+
+    #define OVERLAY_MODULE1     1
+    #define OVERLAY_MODULE2     2
+    #define OVERLAY_MODULE3     3
+    #define OVERLAY_MODULE4     4
+    #define OVERLAY_MODULE5     5
+    #define OVERLAY_MODULE6     6
+    #define OVERLAY_MODULE7     7
+    #define OVERLAY_MODULE8     8
+
+    // Module with the text of the "canto" number "canto" in the language 
+    // "language" (see the makefile).
+    #define TEXT_MODULE(canto, language)    (OVERLAY_MODULE5 + ((canto) - 1) * 2 + (language))
+
+    // Number of overlay slots, that is, the number of modules that can be 
+    // resident at the same time. It must match the memory areas defined by 
+    // the linker configuration files (see the cfg directory). The last slot 
+    // holds the text modules. When the modules are relocatable (see the
+    // __RELOCATE__ symbol below), the whole overlay area is shared by them:
+    // each resident module takes a slot, wherever it has been placed.
+    #if defined(__RELOCATE__)
+        #define OVERLAY_SLOTS   OVERLAY_MODULES
+    #elif defined(__C64__)
+        #define OVERLAY_SLOTS   3
+    #else
+        #define OVERLAY_SLOTS   2
+    #endif
+
+    // Slots are identified by a bit into a mask. Each module is linked into
+    // a single slot (its memory area, see the cfg directory), so its mask 
+    // has exactly one bit: masks just make it cheap to tell if two modules
+    // share the same slot.
+    #define OVERLAY_SLOT1       0x01
+    #define OVERLAY_SLOT2       0x02
+    #define OVERLAY_SLOT3       0x04
+
+    // This structure describes a single module: the name of the file on the 
+    // mass storage, the address and the size of the memory area where it 
+    // will be loaded, the slot it is loaded into, and the functions 
+    // that can be called once loaded.
+    typedef struct overlay_module {
+        char* name;
+        void* load_address;
+        void* size;
+        unsigned char slots;
+        void (* const * entries)(void);
+        unsigned char entry_count;
+    } overlay_module;
+
+    // This structure describes a single slot: the module that is resident 
+    // into it (0 = none), and when it has been used for the last time. A 
+    // relocatable module also tells the pages of the overlay area it takes.
+    typedef struct overlay_slot {
+        unsigned char module;
+        unsigned char used;
+        #ifdef __RELOCATE__
+        unsigned char page;
+        unsigned char pages;
+        #endif
+    } overlay_slot;
+
+    // Table of the modules, and the overlay manager status.
+    extern const overlay_module overlay_modules[OVERLAY_MODULES];
+    extern overlay_slot overlay_slots[OVERLAY_SLOTS];
+    extern unsigned char overlay_clock;
+    extern unsigned int overlay_hits;
+    extern unsigned int overlay_misses;
+
+    unsigned char require_overlay(unsigned char module);
+
+    // The functions of a module can call the ones of another module,
+    // through their trampolines. Every call made through a trampoline is
+    // recorded on a small return stack, with the module called on the top:
+    // when the function returns, the module of the caller (the one on the
+    // top again, if any) is made present once more, since it could have
+    // been replaced meanwhile (see ovlcall.s). The trampolines keep there
+    // the addresses where the functions return too. OVERLAY_DEPTH calls
+    // can be nested.
+    #define OVERLAY_DEPTH       8
+
+    extern unsigned char overlay_stack[OVERLAY_DEPTH];
+    extern unsigned char overlay_depth;
+    #ifndef __HOST__
+    extern void* overlay_returns[OVERLAY_DEPTH];
+    #endif
+
+    unsigned char overlay_call(unsigned char module);
+    void overlay_return(void);
+
+    // The modules can be made relocatable, by defining the __RELOCATE__ 
+    // symbol at compile time (see RELOCATE into the makefile): each of them
+    // is placed wherever there is room into the overlay area, and moved
+    // there by the table of relocations that follows it on the disk (see 
+    // tools/ovlreloc.c). After require_overlay(), this is the address where 
+    // the module has been placed.
+    #ifdef __RELOCATE__
+
+        extern unsigned char* overlay_base;
+
+    #endif
+
+    // Modules can be loaded in the background while the program waits for 
+    // a key, by defining the __PREFETCH__ symbol at compile time (see the 
+    // overlay.c file).
+    #ifdef __PREFETCH__
+
+        extern unsigned int overlay_prefetches;
+
+        void prefetch_overlay(unsigned char module, unsigned char running);
+        void overlay_idle(void);
+
+    #endif
+
+    // The overlay manager can be instrumented by defining the 
+    // __OVERLAY_STATS__ symbol at compile time. For each module, it counts 
+    // how many times it has been read from the mass storage, how many bytes 
+    // have been read and how many jiffies (of the KERNAL clock) the loads 
+    // took. The loading routines put the bytes read by the current load 
+    // into overlay_transferred.
+    #ifdef __OVERLAY_STATS__
+
+        typedef struct overlay_stats {
+            unsigned int loads;
+            unsigned long bytes;
+            unsigned long jiffies;
+            #ifdef __OVERLAY_BENCH__
+            unsigned long cycles;
+            #endif
+            #ifdef __OVERLAY_STACK__
+            unsigned int stack;
+            #endif
+        } overlay_stats;
+
+        extern overlay_stats overlay_statistics[OVERLAY_MODULES];
+        extern unsigned int overlay_transferred;
+
+        void overlay_dump(void);
+
+        #ifdef __CBM__
+            unsigned char overlay_save(void);
+        #endif
+
+        // The debug build (__OVERLAY_STACK__, see STACKCHECK into the 
+        // makefile) measures the deepest use of the C stack too, while each
+        // module is running: the free memory must be painted at startup.
+        #ifdef __OVERLAY_STACK__
+            void overlay_stack_paint(void);
+        #endif
+
+        // The benchmark build (__OVERLAY_BENCH__, see "make bench") counts 
+        // the cycles of each load too, and it leaves the emulator when the 
+        // user quits.
+        #ifdef __OVERLAY_BENCH__
+            unsigned long overlay_cycles(void);
+            void overlay_bench_exit(unsigned char saved);
+        #endif
+
+    #endif
+
+    // The position of each module on the disk can be written into the 
+    // resident program by the "ovltrack" tool, by defining the __DIRECT__ 
+    // symbol at compile time: the table starts with a signature (so that 
+    // the tool can find it) and with the number of modules.
+    #if defined(__CBM__) && defined(__DIRECT__)
+
+        typedef struct overlay_track {
+            unsigned char track;
+            unsigned char sector;
+            unsigned char blocks;
+        } overlay_track;
+
+        typedef struct overlay_directory {
+            unsigned char signature[8];
+            unsigned char count;
+            overlay_track modules[OVERLAY_MODULES];
+        } overlay_directory;
+
+        extern overlay_directory overlay_tracks;
+
+    #endif
+
+    // The overlayed executable for cartridges (__CARTRIDGE__, see the 
+    // "c64crt" target) has the modules into the banks of a Magic Desk 
+    // cartridge: the "ovlcart" tool writes where each module starts (the 
+    // bank and the page), where it goes and its size into this table (found
+    // by its signature), and cartridge_load() copies it (see cartridge.s).
+    #if defined(__C64__) && defined(__CARTRIDGE__)
+
+        typedef struct overlay_bank {
+            unsigned char bank;
+            unsigned char page;
+            unsigned char* address;
+            unsigned int size;
+        } overlay_bank;
+
+        typedef struct overlay_cartridge {
+            unsigned char signature[8];
+            unsigned char count;
+            overlay_bank modules[OVERLAY_MODULES];
+        } overlay_cartridge;
+
+        extern overlay_cartridge overlay_banks;
+
+        void cartridge_load(const overlay_bank* module);
+
+    #endif
+
+    // The overlayed executable for tapes (__TAPE__, see the "c64tap" 
+    // target) has the modules on the tape, after the program: the "ovltape"
+    // tool writes them in the order they are expected to be loaded, and 
+    // tape_load() reads the tape forward until the module is found (see 
+    // tape.s), putting its size into tape_size.
+    #if defined(__C64__) && defined(__TAPE__)
+
+        // Result of a load.
+        #define TAPE_OK             0
+        #define TAPE_END            1
+        #define TAPE_ERROR          2
+
+        extern unsigned int tape_size;
+
+        unsigned char tape_load(unsigned char module);
+
+    #endif
+
+    // Each overlayed function is defined, into its module, with the name 
+    // given by this macro. The original name is given to a small resident 
+    // "trampoline" (generated at build time by the "ovlstub" tool starting 
+    // from the annotations below), that makes the module resident before 
+    // jumping to the real function. So callers can just call the function.
+    #define OVERLAYED(function)     function##_overlayed
+
+    // The fast-loader for the 1541 is enabled by defining the __FASTLOAD__ 
+    // symbol at compile time. It is uploaded into the drive at startup, and 
+    // then it is used by the overlay manager instead of cbm_load().
+    #if defined(__CBM__) && defined(__FASTLOAD__)
+
+        // Status of the last transfer.
+        #define FASTLOAD_OK         0
+        #define FASTLOAD_EOF        1
+        #define FASTLOAD_ERROR      2
+
+        extern unsigned char fastload_active;
+        extern unsigned char fastload_status;
+        extern unsigned char fastload_drive_code[];
+        extern unsigned int fastload_drive_size;
+        extern unsigned int fastload_drive_start;
+
+        void fastload_install(void);
+        unsigned char fastload_ready(void);
+        void fastload_putc(unsigned char c);
+        int fastload_getc(void);
+        unsigned char fastload_open(char* name);
+        unsigned char fastload_load(char* name);
+        unsigned char fastload_open_direct(unsigned char track, unsigned char sector);
+        unsigned char fastload_load_direct(unsigned char track, unsigned char sector);
+        void fastload_exit(void);
+
+    #endif
+
+    // The profile build (__OVERLAY_PROFILE__, see "make profile") marks 
+    // every module that is made present into the overlay area, so that the 
+    // "ovlprof" tool can tell which one is running (see ovlcall.s).
+    #if defined(__CBM__) && defined(__OVERLAY_PROFILE__)
+
+        void overlay_mark(unsigned char module);
+
+    #endif
+
+    // On the VIC-20, the memory expansions can be used as a cache for the 
+    // modules, by defining the __VICRAM__ symbol at compile time: they are
+    // looked for at startup.
+    #if defined(__VIC20__) && defined(__VICRAM__)
+
+        void overlay_probe(void);
+
+    #endif
+
+    // On the C64, the RAM hidden under the I/O area and the KERNAL ROM can 
+    // be used as a cache for the modules, by defining the __HIRAM__ symbol 
+    // at compile time.
+    #if defined(__C64__) && defined(__HIRAM__)
+
+        void hiram_copy(void* destination, void* source, unsigned char pages);
+
+    #endif
+
+#else
+
+    // Without overlays, every function is defined with its own name.
+    #define OVERLAYED(function)     function
+
+#endif
+
+// The verses can be compressed at build time by the "ovltext" tool, by 
+// defining the __PACKTEXT__ symbol at compile time: the strings passed to 
+// write_verse() become arrays of bytes, where the ones from TEXT_TOKEN are 
+// entries of a resident dictionary (or TEXT_ESCAPE, that is followed by a 
+// character). No verse can be longer than TEXT_LINE characters.
+// Moreover, the text of each "canto" is split by language into modules of 
+// its own, and it is printed by write_text(): a sequence of verses, where 
+// TEXT_PAUSE waits for a key and TEXT_END ends the text.
+#ifdef __PACKTEXT__
+
+    #define TEXT_TOKEN          0x80
+    #define TEXT_END            0xbd
+    #define TEXT_PAUSE          0xbe
+    #define TEXT_ESCAPE         0xbf
+    #define TEXT_LINE           80
+
+    extern const unsigned char text_offsets[];
+    extern const unsigned char text_dictionary[];
+
+#endif
+
+// The text can be written straight into the screen memory of Commodore 
+// targets, instead of through the standard library, by defining the 
+// __SCREEN__ symbol at compile time (see screen.c): every line of text is 
+// written by write_line().
+#if defined(__CBM__) && defined(__SCREEN__)
+
+    void screen_clear(void);
+    void screen_line(const char* text);
+
+    #define write_line(text)    screen_line(text)
+
+#else
+
+    #define write_line(text)    puts(text)
 
 #endif
 
@@ -29,6 +377,10 @@
 void write_title(char* title);
 void write_verse(char* verse);
 void press_any_key(void);
+int wait_key(void);
+#ifdef __PACKTEXT__
+void write_text(unsigned char module, const unsigned char* text);
+#endif
 
 // OVERLAYED FUNCTIONS (MODULE 1)
 void canto1(void);
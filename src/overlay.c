@@ -0,0 +1,2056 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * OVERLAY MANAGER (RESIDENT MODULE)                                        *
+ ****************************************************************************/
+
+/****************************************************************************
+ ** INCLUDE SECTION
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cc65.h>
+
+#include "main.h"
+
+// Overlay management is driven by the definition of the appropriate
+// compilation symbol (__OVERLAY__). In this case, we enable or disable the
+// compilation of the relevant code.
+
+#ifdef __OVERLAY__
+
+    // Relocatable modules are moved while they are decompressed, and they
+    // have no slot of their own where the caches could bring them back.
+    #if defined(__RELOCATE__) && (!defined(__COMPRESS__) || defined(__REU__) || defined(__HIRAM__) || defined(__VICRAM__))
+        #error "Relocatable modules need __COMPRESS__, and no cache (__REU__, __HIRAM__, __VICRAM__)"
+    #endif
+
+    // The modules of a cartridge are copied from its banks as they are.
+    #if defined(__CARTRIDGE__) && (defined(__COMPRESS__) || defined(__FASTLOAD__) || defined(__DIRECT__) || defined(__PREFETCH__) || defined(__RELOCATE__) || defined(__REU__) || defined(__HIRAM__))
+        #error "Cartridge modules need no loader, compression, cache or relocation"
+    #endif
+
+    // The modules on a tape are read by the turbo loader as they are, in 
+    // the order they have been written.
+    #if defined(__TAPE__) && (!defined(__C64__) || defined(__CARTRIDGE__) || defined(__COMPRESS__) || defined(__FASTLOAD__) || defined(__DIRECT__) || defined(__PREFETCH__) || defined(__RELOCATE__) || defined(__REU__) || defined(__HIRAM__))
+        #error "Tape modules need the C64, and no other loader, compression, cache or relocation"
+    #endif
+
+    /************************************************************************
+     ** MODULE DESCRIPTORS SECTION
+     ************************************************************************/
+
+    // Every module that can be "overlayed" is described by an entry of this
+    // table: the name of the file on the mass storage, the address and the
+    // size of the memory area reserved to it by the linker, the slots it
+    // has been linked for and the list of functions that can be called once
+    // it is in memory. The module number
+    // used by the rest of the program is the position in the table plus one
+    // (0 means "no module"). Note that the entry points are the real 
+    // functions, and not the trampolines that load the module.
+
+    extern void OVERLAYED(canto1)(void);
+    extern void OVERLAYED(canto2)(void);
+    extern void OVERLAYED(presentation)(void);
+    extern void OVERLAYED(choose_language)(void);
+    extern void OVERLAYED(choose_canto)(void);
+
+    static void (* const module1_entries[])(void) = { OVERLAYED(canto1) };
+    static void (* const module2_entries[])(void) = { OVERLAYED(canto2) };
+    static void (* const module3_entries[])(void) = { OVERLAYED(presentation), 
+                                                            OVERLAYED(choose_language) };
+    static void (* const module4_entries[])(void) = { OVERLAYED(choose_canto) };
+
+    // The slot of each module must match the memory area where the linker
+    // placed it (see the cfg directory). On the C64 the "canti" live into
+    // the first slot and the menus into the second one, so the main loop
+    // can go back and forth between them without loading anything. The 
+    // text of a "canto" lives into the last slot, together with its code: 
+    // only the text of the chosen language is loaded.
+
+    #ifdef __C64__
+        #define MENU_SLOT       OVERLAY_SLOT2
+        #define TEXT_SLOT       OVERLAY_SLOT3
+    #else
+        #define MENU_SLOT       OVERLAY_SLOT1
+        #define TEXT_SLOT       OVERLAY_SLOT2
+    #endif
+
+    const overlay_module overlay_modules[OVERLAY_MODULES] = {
+        { "demo.1", _OVERLAY1_LOAD__, _OVERLAY1_SIZE__, OVERLAY_SLOT1, module1_entries, 1 },
+        { "demo.2", _OVERLAY2_LOAD__, _OVERLAY2_SIZE__, OVERLAY_SLOT1, module2_entries, 1 },
+        { "demo.3", _OVERLAY3_LOAD__, _OVERLAY3_SIZE__, MENU_SLOT, module3_entries, 2 },
+        { "demo.4", _OVERLAY4_LOAD__, _OVERLAY4_SIZE__, MENU_SLOT, module4_entries, 1 }
+    #ifdef __PACKTEXT__
+        ,
+        { "demo.1.it", _OVERLAY5_LOAD__, _OVERLAY5_SIZE__, TEXT_SLOT, NULL, 0 },
+        { "demo.1.en", _OVERLAY6_LOAD__, _OVERLAY6_SIZE__, TEXT_SLOT, NULL, 0 },
+        { "demo.2.it", _OVERLAY7_LOAD__, _OVERLAY7_SIZE__, TEXT_SLOT, NULL, 0 },
+        { "demo.2.en", _OVERLAY8_LOAD__, _OVERLAY8_SIZE__, TEXT_SLOT, NULL, 0 }
+    #endif
+    };
+
+    /************************************************************************
+     ** RESIDENT VARIABLES SECTION
+     ************************************************************************/
+
+    // Modules currently present into the overlay slots (0 = none).
+    overlay_slot overlay_slots[OVERLAY_SLOTS];
+
+    // It is incremented at each request, and it is used to find the least
+    // recently used slot.
+    unsigned char overlay_clock = 0;
+
+    // Number of requests satisfied without accessing the mass storage.
+    unsigned int overlay_hits = 0;
+
+    // Number of requests that needed a load (from the mass storage, or from
+    // one of the caches).
+    unsigned int overlay_misses = 0;
+
+    // Return stack of the calls made through the trampolines: the modules
+    // called and, on the retrocomputers, the addresses where the functions
+    // return (see ovlcall.s).
+    unsigned char overlay_stack[OVERLAY_DEPTH];
+    unsigned char overlay_depth = 0;
+    #ifndef __HOST__
+    void* overlay_returns[OVERLAY_DEPTH];
+    #endif
+
+    /************************************************************************
+     ** OVERLAY LOADING SECTION
+     ************************************************************************/
+
+    // We differentiate management if we are with a Commodore system or not.
+    // The difference lies in the fact that, in the case of "commodore"
+    // (__CBM__) targets, we take advantage of the fact that the binaries
+    // produced contain, at the beginning of the file, the starting position
+    // where to load the code. The modules of a cartridge, instead, are not
+    // loaded from a mass storage at all, and the ones on a tape are read by
+    // a loader of their own.
+
+    #if defined(__CBM__) && defined(__CARTRIDGE__)
+
+        //-------------------------------------------------------------------
+        // CARTRIDGE OVERLAY MANAGEMENT
+        //-------------------------------------------------------------------
+
+        // The KERNAL is still used to write the statistics on the disk.
+        #include <cbm.h>
+        #include <device.h>
+
+        // The position of each module into the banks of the cartridge is
+        // written into this table by the "ovlcart" tool, that patches the 
+        // resident program before writing it into the cartridge image (it
+        // looks for the signature). A module is brought into its slot by 
+        // showing its banks and copying it, a page at a time.
+
+        overlay_cartridge overlay_banks = {
+            { 0x4f, 0x56, 0x4c, 0x42, 0x41, 0x4e, 0x4b, 0x53 },
+            OVERLAY_MODULES
+        };
+
+        /**
+         * This function copies the module (code / data) number "module" 
+         * from the banks of the cartridge into its slot.
+         * It returns 0 if any error occours, and print out an error message.
+         */
+        unsigned char load_overlay(unsigned char module)
+        {
+            const overlay_bank* position = &overlay_banks.modules[module - 1];
+
+            if (position->size == 0) {
+                write_line("Internal error - errore interno.");
+                return 0;
+            }
+            cartridge_load(position);
+            #ifdef __OVERLAY_STATS__
+            overlay_transferred = position->size;
+            #endif
+            return 1;
+        }
+
+    #elif defined(__CBM__) && defined(__TAPE__)
+
+        //-------------------------------------------------------------------
+        // TAPE OVERLAY MANAGEMENT
+        //-------------------------------------------------------------------
+
+        // The KERNAL is still used to write the statistics on the disk.
+        #include <cbm.h>
+        #include <device.h>
+
+        // The modules follow the program on the tape, in the order of a 
+        // typical session, and a module loaded more than once is written 
+        // more than once: so the tape is read forward, and each load goes
+        // on from where the previous one stopped. When the end of the tape
+        // is reached before the module, the user is asked to rewind it.
+        // Note that the clock of the KERNAL is stopped while the tape is
+        // read, so the jiffies of the loads are less than the real ones.
+
+        // The PLAY key of the datasette is down if this bit is 0.
+        #define TAPE_SENSE      (*(unsigned char*)0x01 & 0x10)
+
+        /**
+         * This function waits for the PLAY key of the datasette.
+         */
+        static void tape_play(void)
+        {
+            if (TAPE_SENSE) {
+                write_line("Press play on tape - premere play.");
+                while (TAPE_SENSE) ;
+            }
+        }
+
+        /**
+         * This function loads the module (code / data) number "module" 
+         * from the tape into its slot.
+         * It returns 0 if any error occours, and print out an error message.
+         */
+        unsigned char load_overlay(unsigned char module)
+        {
+            unsigned char result;
+
+            tape_play();
+            result = tape_load(module);
+            if (result == TAPE_END) {
+                write_line("Rewind the tape - riavvolgere il nastro.");
+                press_any_key();
+                tape_play();
+                result = tape_load(module);
+            }
+            if (result != TAPE_OK) {
+                write_line("Load error - errore di caricamento.");
+                return 0;
+            }
+            #ifdef __OVERLAY_STATS__
+            overlay_transferred = tape_size;
+            #endif
+            return 1;
+        }
+
+    #elif !defined(__CBM__)
+
+        //-------------------------------------------------------------------
+        // GENERAL OVERLAY MANAGEMENT
+        //-------------------------------------------------------------------
+
+        #include <fcntl.h>
+        #include <unistd.h>
+
+        #ifndef __COMPRESS__
+
+        /**
+         * This function loads the module (code / data) number "module" from
+         * the mass storage into memory. The module will be loaded starting
+         * from the address given by its descriptor, for the length given by
+         * the same descriptor.
+         * It returns 0 if any error occours, and print out an error message.
+         */
+        unsigned char load_overlay(unsigned char module)
+        {
+            const overlay_module* descriptor = &overlay_modules[module - 1];
+            int f = open(descriptor->name, O_RDONLY);
+            if (f == -1) {
+                write_line("Internal error - errore interno.");
+                return 0;
+            }
+            #ifdef __OVERLAY_STATS__
+            overlay_transferred = read(f, descriptor->load_address, (unsigned)(size_t)descriptor->size);
+            #else
+            read(f, descriptor->load_address, (unsigned)(size_t)descriptor->size);
+            #endif
+            close(f);
+            return 1;
+        }
+
+        #else
+
+        // File descriptor of the module that is being read.
+        static int overlay_file;
+
+        /**
+         * This function opens the module number "module", in order to read
+         * it byte by byte. It returns 0 if any error occours.
+         */
+        static unsigned char overlay_open(unsigned char module)
+        {
+            overlay_file = open(overlay_modules[module - 1].name, O_RDONLY);
+            return (overlay_file != -1);
+        }
+
+        /**
+         * This function reads the next byte of the module. It returns -1 at
+         * the end of the file, or if any error occours.
+         */
+        static int overlay_getc(void)
+        {
+            unsigned char c;
+            if (read(overlay_file, &c, 1) != 1) {
+                return -1;
+            }
+            #ifdef __OVERLAY_STATS__
+            ++overlay_transferred;
+            #endif
+            return c;
+        }
+
+        /**
+         * This function closes the module.
+         */
+        static void overlay_close(void)
+        {
+            close(overlay_file);
+        }
+
+        #ifdef __PREFETCH__
+
+        /**
+         * These functions are called while the module is read a piece at a
+         * time: there is nothing to do, since it is read by its descriptor.
+         */
+        static void overlay_suspend(void)
+        {
+        }
+
+        static void overlay_resume(void)
+        {
+        }
+
+        #endif
+
+        #endif
+
+    #else
+
+        //-------------------------------------------------------------------
+        // COMMODORE OVERLAY MANAGEMENT
+        //-------------------------------------------------------------------
+
+        #include <cbm.h>
+        #include <device.h>
+
+        // Logical file number used to read the modules with the KERNAL.
+        #define OVERLAY_LFN     2
+
+        #ifdef __DIRECT__
+
+        //-------------------------------------------------------------------
+        // DIRECT ACCESS TO THE MODULES
+        //-------------------------------------------------------------------
+
+        // If the __DIRECT__ symbol has been defined at compile time (see
+        // the makefile), the position of each module on the disk is written
+        // into this table by the "ovltrack" tool, that patches the resident
+        // program directly into the disk image (it looks for the signature).
+        // So the modules can be read block by block, starting from their
+        // first track and sector, without looking for them into the
+        // directory. If the table has not been filled (track 0), modules
+        // are looked for by name.
+
+        overlay_directory overlay_tracks = {
+            { 0x4f, 0x56, 0x4c, 0x54, 0x52, 0x41, 0x43, 0x4b },
+            OVERLAY_MODULES
+        };
+
+        // Logical file number, secondary address and logical file number
+        // of the command channel used to read the blocks with the KERNAL.
+        #define DIRECT_SA       2
+        #define DIRECT_LFN      15
+
+        // Character of the "U1" (block read) DOS command, as a number: it
+        // must not be translated into PETSCII.
+        #define DOS_U           0x55
+
+        // It is set while a module is being read block by block.
+        static unsigned char direct_active;
+
+        // Next block to read (track 0 = none), position of the next byte 
+        // into the current block and position of its last byte.
+        static unsigned char direct_track;
+        static unsigned char direct_sector;
+        static unsigned char direct_index;
+        static unsigned char direct_last;
+
+        // It is set if a block could not be read.
+        static unsigned char direct_failed;
+
+        /**
+         * This function puts the decimal representation of "number" (that
+         * is less than 100) into "command", starting from position "length".
+         * It returns the new length of the command.
+         */
+        static unsigned char direct_number(unsigned char* command, unsigned char length, unsigned char number)
+        {
+            command[length++] = ' ';
+            if (number >= 10) {
+                command[length++] = '0' + number / 10;
+            }
+            command[length++] = '0' + number % 10;
+            return length;
+        }
+
+        /**
+         * This function asks the drive to read the next block of the module
+         * into its buffer, and it reads the link to the following one. It
+         * returns 0 if any error occours.
+         */
+        static unsigned char direct_block(void)
+        {
+            unsigned char command[16];
+            unsigned char length;
+
+            command[0] = DOS_U; command[1] = '1'; command[2] = ':';
+            command[3] = '0' + DIRECT_SA;
+            length = direct_number(command, 4, 0);
+            length = direct_number(command, length, direct_track);
+            length = direct_number(command, length, direct_sector);
+            if (cbm_write(DIRECT_LFN, command, length) != length) {
+                return 0;
+            }
+
+            // Since the command has been sent, the channel of the buffer
+            // must be selected again.
+            if (cbm_k_chkin(OVERLAY_LFN) != 0) {
+                return 0;
+            }
+            direct_track = cbm_k_basin();
+            direct_sector = cbm_k_basin();
+            direct_index = 2;
+            direct_last = direct_track ? 255 : direct_sector;
+            return 1;
+        }
+
+        /**
+         * This function opens the buffer and the command channel of the
+         * drive, in order to read the module that starts from "track" and
+         * "sector" block by block. It returns 0 if any error occours.
+         */
+        static unsigned char direct_open(unsigned char track, unsigned char sector)
+        {
+            unsigned char device = getcurrentdevice();
+
+            if (cbm_open(DIRECT_LFN, device, 15, "") != 0) {
+                return 0;
+            }
+            if (cbm_open(OVERLAY_LFN, device, DIRECT_SA, "#") != 0) {
+                cbm_close(DIRECT_LFN);
+                return 0;
+            }
+            direct_active = 1;
+            direct_failed = 0;
+            direct_track = track;
+            direct_sector = sector;
+            direct_index = 1;
+            direct_last = 0;
+            return 1;
+        }
+
+        /**
+         * This function reads the next byte of the module, block by block.
+         * It returns -1 at the end of the module, or if any error occours.
+         */
+        static int direct_getc(void)
+        {
+            if (direct_index > direct_last) {
+                if (direct_track == 0) {
+                    return -1;
+                }
+                if (!direct_block()) {
+                    direct_failed = 1;
+                    direct_track = 0;
+                    return -1;
+                }
+            }
+            ++direct_index;
+            return cbm_k_basin();
+        }
+
+        /**
+         * This function closes the buffer and the command channel.
+         */
+        static void direct_close(void)
+        {
+            cbm_k_clrch();
+            cbm_close(OVERLAY_LFN);
+            cbm_close(DIRECT_LFN);
+            direct_active = 0;
+        }
+
+        #ifndef __COMPRESS__
+
+        /**
+         * This function loads the module number "module", that starts from
+         * the track and the sector present into the table, into the address
+         * present in the header of the binary file.
+         * It returns 0 if any error occours.
+         */
+        static unsigned char direct_load(unsigned char module)
+        {
+            const overlay_track* position = &overlay_tracks.modules[module - 1];
+            unsigned char* destination;
+            #ifdef __OVERLAY_STATS__
+            unsigned char* start;
+            #endif
+            int c;
+
+            #ifdef __FASTLOAD__
+            if (fastload_active) {
+                return fastload_load_direct(position->track, position->sector);
+            }
+            #endif
+            if (!direct_open(position->track, position->sector)) {
+                return 0;
+            }
+            destination = (unsigned char*)direct_getc();
+            destination += direct_getc() << 8;
+            #ifdef __OVERLAY_STATS__
+            start = destination;
+            #endif
+            while ((c = direct_getc()) >= 0) {
+                *destination++ = (unsigned char)c;
+            }
+            #ifdef __OVERLAY_STATS__
+            overlay_transferred = destination - start + 2;
+            #endif
+            direct_close();
+            return !direct_failed;
+        }
+
+        #endif
+
+        #endif
+
+        #ifndef __COMPRESS__
+
+        /**
+         * This function loads the module (code / data) number "module" from
+         * the mass storage into the address present in the header of the
+         * binary file. If the fast-loader has been installed into the drive,
+         * it is used instead of the (slow) KERNAL routines.
+         * It returns 0 if any error occours, and print out an error message.
+         */
+        unsigned char load_overlay(unsigned char module)
+        {
+            char* module_name = overlay_modules[module - 1].name;
+            unsigned char result;
+
+            #ifdef __DIRECT__
+            if (overlay_tracks.modules[module - 1].track != 0) {
+                result = direct_load(module);
+            } else
+            #endif
+            #ifdef __FASTLOAD__
+            if (fastload_active) {
+                result = fastload_load(module_name);
+            } else
+            #endif
+            {
+                #ifdef __OVERLAY_STATS__
+                // The KERNAL does not count the address into the header.
+                overlay_transferred = cbm_load(module_name, getcurrentdevice(), NULL);
+                result = (overlay_transferred != 0);
+                overlay_transferred += 2;
+                #else
+                result = (cbm_load(module_name, getcurrentdevice(), NULL) != 0);
+                #endif
+            }
+            if (!result) {
+                write_line("Internal error - errore interno.");
+            }
+            return result;
+        }
+
+        #else
+
+        // It is set when the KERNAL signals the end of the file.
+        static unsigned char overlay_eof;
+
+        /**
+         * This function opens the module number "module", in order to read
+         * it byte by byte (by the fast-loader, if it has been installed into
+         * the drive, and by its position on the disk, if it is known).
+         * It returns 0 if any error occours.
+         */
+        static unsigned char overlay_open(unsigned char module)
+        {
+            char* module_name = overlay_modules[module - 1].name;
+
+            #ifdef __DIRECT__
+            const overlay_track* position = &overlay_tracks.modules[module - 1];
+            if (position->track != 0) {
+                #ifdef __FASTLOAD__
+                if (fastload_active) {
+                    return fastload_open_direct(position->track, position->sector);
+                }
+                #endif
+                return direct_open(position->track, position->sector);
+            }
+            #endif
+            #ifdef __FASTLOAD__
+            if (fastload_active) {
+                return fastload_open(module_name);
+            }
+            #endif
+            overlay_eof = 0;
+            if (cbm_open(OVERLAY_LFN, getcurrentdevice(), 0, module_name) != 0) {
+                return 0;
+            }
+            if (cbm_k_chkin(OVERLAY_LFN) != 0) {
+                cbm_close(OVERLAY_LFN);
+                return 0;
+            }
+            return 1;
+        }
+
+        /**
+         * This function reads the next byte of the module. It returns -1 at
+         * the end of the file, or if any error occours.
+         */
+        static int overlay_getc(void)
+        {
+            unsigned char c;
+            unsigned char status;
+
+            // Since the end marker is the last byte of a module, the end of
+            // the file is not reached (and counted) unless an error occours.
+            #ifdef __OVERLAY_STATS__
+            ++overlay_transferred;
+            #endif
+
+            #ifdef __FASTLOAD__
+            if (fastload_active) {
+                return fastload_getc();
+            }
+            #endif
+            #ifdef __DIRECT__
+            if (direct_active) {
+                return direct_getc();
+            }
+            #endif
+            if (overlay_eof) {
+                return -1;
+            }
+            c = cbm_k_basin();
+            status = cbm_k_readst();
+            if (status & 0xbf) {
+                overlay_eof = 1;
+                return -1;
+            }
+            if (status & 0x40) {
+                overlay_eof = 1;
+            }
+            return c;
+        }
+
+        #ifdef __PREFETCH__
+
+        /**
+         * This function gives the keyboard and the screen back to the 
+         * program, while the module is read a piece at a time: the KERNAL 
+         * reads from the channel selected last, and printing selects the 
+         * screen again. The fast-loader does not use the channels.
+         */
+        static void overlay_suspend(void)
+        {
+            #ifdef __FASTLOAD__
+            if (fastload_active) {
+                return;
+            }
+            #endif
+            cbm_k_clrch();
+        }
+
+        /**
+         * This function selects again the channel of the module, in order
+         * to continue reading it.
+         */
+        static void overlay_resume(void)
+        {
+            #ifdef __FASTLOAD__
+            if (fastload_active) {
+                return;
+            }
+            #endif
+            cbm_k_chkin(OVERLAY_LFN);
+        }
+
+        #endif
+
+        /**
+         * This function closes the module.
+         */
+        static void overlay_close(void)
+        {
+            #ifdef __FASTLOAD__
+            if (fastload_active) {
+                // The whole file must be received, to keep the drive code
+                // in sync with us.
+                while (fastload_getc() >= 0) ;
+                return;
+            }
+            #endif
+            #ifdef __DIRECT__
+            if (direct_active) {
+                direct_close();
+                return;
+            }
+            #endif
+            cbm_k_clrch();
+            cbm_close(OVERLAY_LFN);
+        }
+
+        #endif
+
+    #endif
+
+    #ifdef __COMPRESS__
+
+        //-------------------------------------------------------------------
+        // COMPRESSED MODULES
+        //-------------------------------------------------------------------
+
+        // Modules have been compressed by the "ovlpack" tool. They are
+        // decompressed while the bytes arrive from the mass storage, directly
+        // into the overlay area: back references point to the bytes already
+        // written there, so no other buffer is needed. See tools/ovlpack.c
+        // for the format.
+
+        // Results of a step of the decompression.
+        #define UNPACK_MORE     0
+        #define UNPACK_DONE     1
+        #define UNPACK_ERROR    2
+
+        // Position where the next byte of the module will be written.
+        static unsigned char* unpack_destination;
+
+        #ifdef __RELOCATE__
+
+        // Relocatable modules are decompressed where the overlay manager
+        // placed them (see choose_overlay()), that is the address they have
+        // been linked for plus a number of pages: then, that number is 
+        // added to the high byte of each address listed into the table of 
+        // relocations, that follows the module (see tools/ovlreloc.c).
+        static unsigned char* relocate_base;
+        static unsigned char relocate_delta;
+
+        /**
+         * This function reads the table of relocations of the module that
+         * has been decompressed, and it moves the module. It returns 0 if
+         * any error occours.
+         */
+        static unsigned char relocate(void)
+        {
+            unsigned char* p = relocate_base - 1;
+            unsigned int count;
+            int c;
+
+            count = overlay_getc();
+            count |= overlay_getc() << 8;
+            while (count--) {
+                if ((c = overlay_getc()) < 0) {
+                    return 0;
+                }
+                if (c == 0) {
+                    p += 255;
+                } else {
+                    p += c;
+                    *p += relocate_delta;
+                }
+            }
+            return 1;
+        }
+
+        /**
+         * This function starts the decompression of the module that has
+         * been opened, into the address chosen by the overlay manager.
+         */
+        static void unpack_start(void)
+        {
+            overlay_getc();
+            relocate_delta = ((unsigned int)relocate_base >> 8) - overlay_getc();
+            unpack_destination = relocate_base;
+        }
+
+        #else
+
+        /**
+         * This function starts the decompression of the module that has
+         * been opened, into the address present in its first two bytes.
+         */
+        static void unpack_start(void)
+        {
+            unpack_destination = (unsigned char*)overlay_getc();
+            unpack_destination += overlay_getc() << 8;
+        }
+
+        #endif
+
+        /**
+         * This function decompresses at most "tokens" tokens (256 if zero)
+         * of the module that has been opened: so a module can be loaded a
+         * piece at a time (see overlay_idle()). It returns UNPACK_MORE if
+         * the module is not complete yet, UNPACK_DONE if it is complete,
+         * and UNPACK_ERROR if any error occours.
+         */
+        static unsigned char unpack_step(unsigned char tokens)
+        {
+            unsigned char* destination = unpack_destination;
+            unsigned char* source;
+            unsigned char token;
+            unsigned char length;
+            int c;
+
+            do {
+                // The module is correct only if the end marker has been found
+                // (and, if relocatable, if it has been moved).
+                if ((c = overlay_getc()) <= 0) {
+                    #ifdef __RELOCATE__
+                    return (c == 0 && relocate()) ? UNPACK_DONE : UNPACK_ERROR;
+                    #else
+                    return (c == 0) ? UNPACK_DONE : UNPACK_ERROR;
+                    #endif
+                }
+                token = (unsigned char)c;
+                if (token & 0x80) {
+                    length = ((token >> 3) & 0x0f) + 3;
+                    source = destination - ((((token & 0x07) << 8) | overlay_getc()) + 1);
+                    do {
+                        *destination++ = *source++;
+                    } while (--length);
+                } else {
+                    do {
+                        *destination++ = (unsigned char)overlay_getc();
+                    } while (--token);
+                }
+            } while (--tokens);
+
+            unpack_destination = destination;
+            return UNPACK_MORE;
+        }
+
+        /**
+         * This function loads the compressed module (code / data) number
+         * "module" from the mass storage into the address present in the
+         * header of the file.
+         * It returns 0 if any error occours, and print out an error message.
+         */
+        unsigned char load_overlay(unsigned char module)
+        {
+            unsigned char result = UNPACK_ERROR;
+
+            if (overlay_open(module)) {
+                unpack_start();
+                while ((result = unpack_step(0)) == UNPACK_MORE) ;
+                overlay_close();
+            }
+            if (result != UNPACK_DONE) {
+                write_line("Internal error - errore interno.");
+                return 0;
+            }
+            return 1;
+        }
+
+    #endif
+
+    /************************************************************************
+     ** OVERLAY CACHES SECTION
+     ************************************************************************/
+
+    #if (defined(__C64__) && (defined(__REU__) || defined(__HIRAM__))) || (defined(__VIC20__) && defined(__VICRAM__))
+
+    /**
+     * This function returns the number of pages (of 256 bytes) occupied by
+     * the module described by "descriptor".
+     */
+    static unsigned char overlay_pages(const overlay_module* descriptor)
+    {
+        return (unsigned char)(((unsigned int)descriptor->size + 255) >> 8);
+    }
+
+    #endif
+
+    // On the C64, if the __REU__ symbol has been defined at compile time 
+    // (see the makefile), the overlay manager looks for a RAM Expansion Unit
+    // the first time a module is required. If it is present, all the modules
+    // are loaded once from the mass storage and copied into the REU: from
+    // then on, every module is brought into its slot by a DMA transfer,
+    // without accessing the mass storage at all. If the REU is missing (or
+    // a module does not fit into it), modules are loaded as usual.
+
+    #if defined(__C64__) && defined(__REU__)
+
+        #include <c64.h>
+        #include <em.h>
+
+        #define OVERLAY_REU
+
+        // Status of the REU.
+        #define REU_UNKNOWN     0
+        #define REU_MISSING     1
+        #define REU_READY       2
+
+        static unsigned char reu_status = REU_UNKNOWN;
+
+        // First page of each module into the REU (0xffff = not cached).
+        static unsigned int reu_pages[OVERLAY_MODULES];
+
+        // Parameters of the DMA transfers.
+        static struct em_copy reu_copy;
+
+        /**
+         * This function prepares the parameters of the DMA transfer for the
+         * module described by "descriptor", cached from "page".
+         */
+        static void reu_prepare(const overlay_module* descriptor, unsigned int page)
+        {
+            reu_copy.buf = descriptor->load_address;
+            reu_copy.offs = 0;
+            reu_copy.page = page;
+            reu_copy.count = (unsigned int)descriptor->size;
+        }
+
+        /**
+         * This function looks for the REU and, if it is present, it fills it
+         * with all the modules. Since they are loaded through the slots,
+         * the slots are emptied.
+         */
+        static void reu_fill(void)
+        {
+            const overlay_module* descriptor;
+            unsigned int page = 0;
+            unsigned int pages;
+            unsigned char i;
+
+            reu_status = REU_MISSING;
+            for (i = 0; i < OVERLAY_MODULES; ++i) {
+                reu_pages[i] = 0xffff;
+            }
+
+            if (em_install(c64_reu_emd) != EM_ERR_OK) {
+                return;
+            }
+            pages = em_pagecount();
+
+            for (i = 0; i < OVERLAY_MODULES; ++i) {
+                descriptor = &overlay_modules[i];
+                if (page + overlay_pages(descriptor) > pages) {
+                    break;
+                }
+                if (!load_overlay(i + 1)) {
+                    continue;
+                }
+                reu_prepare(descriptor, page);
+                em_copyto(&reu_copy);
+                reu_pages[i] = page;
+                page += overlay_pages(descriptor);
+            }
+
+            for (i = 0; i < OVERLAY_SLOTS; ++i) {
+                overlay_slots[i].module = 0;
+            }
+            reu_status = REU_READY;
+        }
+
+        /**
+         * This function copies the module number "module" from the REU into
+         * its slot. It returns 0 if the module is not into the REU.
+         */
+        static unsigned char reu_load(unsigned char module)
+        {
+            if (reu_status != REU_READY || reu_pages[module - 1] == 0xffff) {
+                return 0;
+            }
+            reu_prepare(&overlay_modules[module - 1], reu_pages[module - 1]);
+            em_copyfrom(&reu_copy);
+            return 1;
+        }
+
+    #endif
+
+    // On the C64, if the __HIRAM__ symbol has been defined at compile time 
+    // (see the makefile), the modules are also kept into the RAM hidden under
+    // the I/O area and the KERNAL ROM, the first time they are loaded from
+    // the mass storage (as long as there is room for them). From then on,
+    // they are copied from there into their slot (see hiram.s). This cache
+    // does not need any expansion hardware.
+
+    #if defined(__C64__) && defined(__HIRAM__)
+
+        #define OVERLAY_HIRAM
+
+        // Pages of the hidden RAM used by the cache: the last page is left
+        // alone, since it contains the hardware vectors.
+        #define HIRAM_FIRST     0xd0
+        #define HIRAM_LAST      0xff
+
+        // First page of each module into the hidden RAM (0 = not cached).
+        static unsigned char hiram_pages[OVERLAY_MODULES];
+
+        // First page of the hidden RAM not yet used.
+        static unsigned char hiram_next = HIRAM_FIRST;
+
+        /**
+         * This function copies the module number "module" from the hidden
+         * RAM into its slot. It returns 0 if the module is not there.
+         */
+        static unsigned char hiram_load(unsigned char module)
+        {
+            const overlay_module* descriptor = &overlay_modules[module - 1];
+
+            if (hiram_pages[module - 1] == 0) {
+                return 0;
+            }
+            hiram_copy(descriptor->load_address, (void*)(hiram_pages[module - 1] << 8), 
+                            overlay_pages(descriptor));
+            return 1;
+        }
+
+        /**
+         * This function copies the module number "module", just loaded into
+         * its slot, into the hidden RAM (if there is still room for it).
+         */
+        static void hiram_store(unsigned char module)
+        {
+            const overlay_module* descriptor = &overlay_modules[module - 1];
+            unsigned char pages = overlay_pages(descriptor);
+
+            if (hiram_pages[module - 1] != 0 || pages > HIRAM_LAST - hiram_next) {
+                return;
+            }
+            hiram_copy((void*)(hiram_next << 8), descriptor->load_address, pages);
+            hiram_pages[module - 1] = hiram_next;
+            hiram_next += pages;
+        }
+
+    #endif
+
+    // On the VIC-20, if the __VICRAM__ symbol has been defined at compile 
+    // time (see the makefile), the memory expansions are looked for at 
+    // startup (see overlay_probe()): the blocks that are present (3K at 
+    // $0400, 8K at $2000, $4000, $6000 and $A000) keep the modules, the 
+    // first time they are loaded from the mass storage (as long as there 
+    // is room for them). From then on, they are copied from there into 
+    // their slot. On an unexpanded machine, nothing changes. With 8K or 
+    // more, the program must be started by the boot loader (see 
+    // src/vicboot.s), that moves the screen memory and BASIC out of its way.
+
+    #if defined(__VIC20__) && defined(__VICRAM__)
+
+        #define OVERLAY_VICRAM
+
+        // Number of blocks of the expansions.
+        #define VICRAM_BLOCKS   5
+
+        // First page of each block, and its size (in pages).
+        static const unsigned char vicram_firsts[VICRAM_BLOCKS] = { 0x04, 0x20, 0x40, 0x60, 0xa0 };
+        static const unsigned char vicram_sizes[VICRAM_BLOCKS] = { 0x0c, 0x20, 0x20, 0x20, 0x20 };
+
+        // First page not yet used of each block, and the page that follows
+        // the block (the same, if the block is missing).
+        static unsigned char vicram_next[VICRAM_BLOCKS];
+        static unsigned char vicram_ends[VICRAM_BLOCKS];
+
+        // First page of each module into the expansions (0 = not cached).
+        static unsigned char vicram_pages[OVERLAY_MODULES];
+
+        /**
+         * This function tells if there is RAM at "address": two patterns
+         * are written on two bytes (so that the value left on the bus by 
+         * the first write is not read back) and then the bytes are put 
+         * back as they were.
+         */
+        static unsigned char vicram_test(unsigned char* address)
+        {
+            unsigned char saved0 = address[0];
+            unsigned char saved1 = address[1];
+            unsigned char result;
+
+            address[0] = 0x55;
+            address[1] = 0xaa;
+            result = (address[0] == 0x55 && address[1] == 0xaa);
+            address[0] = 0xaa;
+            address[1] = 0x55;
+            result = result && (address[0] == 0xaa && address[1] == 0x55);
+            address[0] = saved0;
+            address[1] = saved1;
+            return result;
+        }
+
+        /**
+         * This function looks for the memory expansions.
+         */
+        void overlay_probe(void)
+        {
+            unsigned char i;
+
+            for (i = 0; i < VICRAM_BLOCKS; ++i) {
+                vicram_next[i] = vicram_ends[i] = vicram_firsts[i];
+                if (vicram_test((unsigned char*)(vicram_firsts[i] << 8))) {
+                    vicram_ends[i] += vicram_sizes[i];
+                }
+            }
+        }
+
+        /**
+         * This function copies the module number "module" from the memory
+         * expansions into its slot. It returns 0 if the module is not there.
+         */
+        static unsigned char vicram_load(unsigned char module)
+        {
+            const overlay_module* descriptor = &overlay_modules[module - 1];
+
+            if (vicram_pages[module - 1] == 0) {
+                return 0;
+            }
+            memcpy(descriptor->load_address, (void*)(vicram_pages[module - 1] << 8), 
+                            (unsigned int)descriptor->size);
+            return 1;
+        }
+
+        /**
+         * This function copies the module number "module", just loaded into
+         * its slot, into the first block of the memory expansions where
+         * there is still room for it (if any).
+         */
+        static void vicram_store(unsigned char module)
+        {
+            const overlay_module* descriptor = &overlay_modules[module - 1];
+            unsigned char pages = overlay_pages(descriptor);
+            unsigned char i;
+
+            if (vicram_pages[module - 1] != 0) {
+                return;
+            }
+            for (i = 0; i < VICRAM_BLOCKS; ++i) {
+                if (pages <= vicram_ends[i] - vicram_next[i]) {
+                    memcpy((void*)(vicram_next[i] << 8), descriptor->load_address, 
+                                (unsigned int)descriptor->size);
+                    vicram_pages[module - 1] = vicram_next[i];
+                    vicram_next[i] += pages;
+                    return;
+                }
+            }
+        }
+
+    #endif
+
+    /************************************************************************
+     ** OVERLAY MANAGER SECTION
+     ************************************************************************/
+
+    /**
+     * This function returns the index of the slot where the module number
+     * "module" is resident, or OVERLAY_SLOTS if it is not resident.
+     */
+    static unsigned char find_overlay(unsigned char module)
+    {
+        unsigned char i;
+
+        for (i = 0; i < OVERLAY_SLOTS; ++i) {
+            if (overlay_slots[i].module == module) {
+                break;
+            }
+        }
+        return i;
+    }
+
+    #ifdef __RELOCATE__
+
+    // Relocatable modules share the whole overlay area, a page at a time: 
+    // a module is placed into the first free pages where it fits, with the 
+    // same offset into the page as the address it has been linked for. If
+    // there is no room, the least recently used modules are removed until
+    // it fits, but the one required last: it could be still running (since
+    // it could have called the function that requires the new one). The 
+    // modules on the return stack are never removed as well: the functions
+    // that called them would return into another place.
+    extern char _OVERLAYSTART__[], _OVERLAYSIZE__[];
+
+    #define HEAP_FIRST      ((unsigned char)(((unsigned int)_OVERLAYSTART__ + 255) >> 8))
+    #define HEAP_END        ((unsigned char)(((unsigned int)_OVERLAYSTART__ + (unsigned int)_OVERLAYSIZE__) >> 8))
+
+    // Address of the module required last.
+    unsigned char* overlay_base;
+
+    // Module required last, that cannot be removed.
+    static unsigned char heap_keep;
+
+    /**
+     * This function returns 1 if the module number "module" is on the return
+     * stack, that is, if one of its functions is still running.
+     */
+    static unsigned char heap_running(unsigned char module)
+    {
+        unsigned char i;
+
+        for (i = 0; i < overlay_depth; ++i) {
+            if (overlay_stack[i] == module) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * This function returns the number of pages taken by the module 
+     * described by "descriptor".
+     */
+    static unsigned char heap_pages(const overlay_module* descriptor)
+    {
+        return (unsigned char)((((unsigned int)descriptor->load_address & 0xff) + 
+                    (unsigned int)descriptor->size + 255) >> 8);
+    }
+
+    /**
+     * This function returns the first of "pages" free pages of the overlay
+     * area, or 0 if there are not so many free pages in a row.
+     */
+    static unsigned char heap_fit(unsigned char pages)
+    {
+        const overlay_slot* slot;
+        unsigned char page = HEAP_FIRST;
+        unsigned char i;
+
+        // Every time the pages overlap a resident module, they are moved 
+        // after it and they are checked again.
+        do {
+            for (i = 0, slot = overlay_slots; i < OVERLAY_SLOTS; ++i, ++slot) {
+                if (slot->module != 0 && slot->page < page + pages && page < slot->page + slot->pages) {
+                    page = slot->page + slot->pages;
+                    break;
+                }
+            }
+        } while (i < OVERLAY_SLOTS);
+
+        return (page + pages <= HEAP_END) ? page : 0;
+    }
+
+    /**
+     * This function returns the address of the module described by 
+     * "descriptor", when it is placed from the page "page".
+     */
+    static unsigned char* heap_address(const overlay_module* descriptor, unsigned char page)
+    {
+        return (unsigned char*)((page << 8) | ((unsigned int)descriptor->load_address & 0xff));
+    }
+
+    /**
+     * This function returns the index of the slot for the module described
+     * by "descriptor", and it places the module into the overlay area 
+     * (removing the least recently used ones, if needed). It returns 
+     * OVERLAY_SLOTS if there is no room for it.
+     */
+    static unsigned char choose_overlay(const overlay_module* descriptor)
+    {
+        unsigned char pages = heap_pages(descriptor);
+        unsigned char page;
+        unsigned char slot;
+        unsigned char victim;
+        unsigned char age;
+        unsigned char oldest;
+        unsigned char i;
+
+        while ((page = heap_fit(pages)) == 0) {
+            victim = OVERLAY_SLOTS;
+            oldest = 0;
+            for (i = 0; i < OVERLAY_SLOTS; ++i) {
+                if (overlay_slots[i].module == 0 || overlay_slots[i].module == heap_keep || 
+                            heap_running(overlay_slots[i].module)) {
+                    continue;
+                }
+                age = overlay_clock - overlay_slots[i].used;
+                if (victim == OVERLAY_SLOTS || age >= oldest) {
+                    oldest = age;
+                    victim = i;
+                }
+            }
+            if (victim == OVERLAY_SLOTS) {
+                return OVERLAY_SLOTS;
+            }
+            overlay_slots[victim].module = 0;
+        }
+
+        // There is always an empty slot, since the module is not resident.
+        for (slot = 0; overlay_slots[slot].module != 0; ++slot) ;
+        overlay_slots[slot].page = page;
+        overlay_slots[slot].pages = pages;
+        relocate_base = heap_address(descriptor, page);
+        return slot;
+    }
+
+    #else
+
+    /**
+     * This function returns the index of the slot where the module
+     * described by "descriptor" will be loaded: each module is linked into
+     * a single slot, so there is no choice (the module that is there, if 
+     * any, is replaced).
+     */
+    static unsigned char choose_overlay(const overlay_module* descriptor)
+    {
+        unsigned char i;
+
+        for (i = 0; descriptor->slots != (1 << i); ++i) ;
+        return i;
+    }
+
+    #endif
+
+    /**
+     * This function brings the module number "module" into its slot: from
+     * the caches, if it is present into one of them, otherwise from the
+     * mass storage.
+     * It returns 0 if any error occours.
+     */
+    static unsigned char fetch_overlay(unsigned char module)
+    {
+        #ifdef __OVERLAY_STATS__
+        overlay_stats* stats = &overlay_statistics[module - 1];
+        clock_t start;
+        unsigned char result;
+        #endif
+        #ifdef __OVERLAY_BENCH__
+        unsigned long cycles;
+        #endif
+
+        #ifdef OVERLAY_REU
+        if (reu_load(module)) {
+            return 1;
+        }
+        #endif
+        #ifdef OVERLAY_HIRAM
+        if (hiram_load(module)) {
+            return 1;
+        }
+        #endif
+        #ifdef OVERLAY_VICRAM
+        if (vicram_load(module)) {
+            return 1;
+        }
+        #endif
+        #ifdef __OVERLAY_STATS__
+        // Failed loads are counted too: the time has been spent anyway.
+        overlay_transferred = 0;
+        #ifdef __OVERLAY_BENCH__
+        cycles = overlay_cycles();
+        #endif
+        start = clock();
+        result = load_overlay(module);
+        stats->jiffies += clock() - start;
+        #ifdef __OVERLAY_BENCH__
+        stats->cycles += overlay_cycles() - cycles;
+        #endif
+        stats->bytes += overlay_transferred;
+        ++stats->loads;
+        if (!result) {
+            return 0;
+        }
+        #else
+        if (!load_overlay(module)) {
+            return 0;
+        }
+        #endif
+        #ifdef OVERLAY_HIRAM
+        hiram_store(module);
+        #endif
+        #ifdef OVERLAY_VICRAM
+        vicram_store(module);
+        #endif
+        return 1;
+    }
+
+    #ifdef __PREFETCH__
+
+    // If the __PREFETCH__ symbol has been defined at compile time (see the 
+    // makefile), the program can ask for modules that will be probably 
+    // needed soon: they are loaded while the program waits for a key (see 
+    // wait_key() into main.c), by calling overlay_idle() again and again. 
+    // Compressed modules are read a piece at a time, so a key can be 
+    // handled at once; the others are loaded at once. A module is brought 
+    // into its slot as usual: the slot is empty until the module is 
+    // complete, and the module is completed (or abandoned) before anything
+    // else is loaded.
+
+    // Number of tokens decompressed at each call of overlay_idle().
+    #define PREFETCH_TOKENS     8
+
+    // Modules asked for, in order (0 = none).
+    static unsigned char prefetch_queue[OVERLAY_SLOTS];
+
+    // Module being loaded in the background (0 = none), and its slot.
+    static unsigned char prefetch_module;
+    static unsigned char prefetch_slot;
+
+    // Number of modules brought into their slot in the background.
+    unsigned int overlay_prefetches = 0;
+
+    #if defined(__OVERLAY_STATS__) && defined(__OVERLAY_BENCH__)
+    // Cycles at the start of the piece of work being done in the background.
+    static unsigned long prefetch_cycles;
+    #endif
+
+    /**
+     * This function marks the start of a piece of the work done in the 
+     * background.
+     */
+    static void prefetch_mark(void)
+    {
+        #if defined(__OVERLAY_STATS__) && defined(__OVERLAY_BENCH__)
+        prefetch_cycles = overlay_cycles();
+        #endif
+    }
+
+    /**
+     * This function marks the end of a piece of the work done in the 
+     * background: in the benchmark build, its cycles are counted for the 
+     * module being loaded, as if it had been loaded on demand.
+     */
+    static void prefetch_count(void)
+    {
+        #if defined(__OVERLAY_STATS__) && defined(__OVERLAY_BENCH__)
+        overlay_statistics[prefetch_module - 1].cycles += overlay_cycles() - prefetch_cycles;
+        #endif
+    }
+
+    /**
+     * This function asks for the module number "module" to be loaded in the
+     * background. The module "running" is the one that asks for it: the 
+     * slots where it can be loaded are left alone, since it is in use. The 
+     * program must not ask for modules whose slot holds something else in
+     * use. The requests are forgotten as soon as a module is required.
+     * Relocatable modules have no slot of their own: the module required
+     * last (that is, the running one) is never removed to make room.
+     */
+    void prefetch_overlay(unsigned char module, unsigned char running)
+    {
+        unsigned char i;
+
+        #ifdef __RELOCATE__
+        (void)running;
+        if (find_overlay(module) < OVERLAY_SLOTS || module == prefetch_module) {
+            return;
+        }
+        #else
+        if ((overlay_modules[module - 1].slots & overlay_modules[running - 1].slots) ||
+                    find_overlay(module) < OVERLAY_SLOTS || module == prefetch_module) {
+            return;
+        }
+        #endif
+        for (i = 0; i < OVERLAY_SLOTS; ++i) {
+            if (prefetch_queue[i] == module) {
+                return;
+            }
+            if (prefetch_queue[i] == 0) {
+                prefetch_queue[i] = module;
+                return;
+            }
+        }
+    }
+
+    /**
+     * This function ends the loading in the background: if "result" is not
+     * 0, the module is marked as present into its slot. The bytes read are
+     * counted for the module, even if the load failed.
+     */
+    static void prefetch_end(unsigned char result)
+    {
+        #ifdef __OVERLAY_STATS__
+        overlay_statistics[prefetch_module - 1].bytes += overlay_transferred;
+        #endif
+        if (result) {
+            #ifdef OVERLAY_HIRAM
+            hiram_store(prefetch_module);
+            #endif
+            #ifdef OVERLAY_VICRAM
+            vicram_store(prefetch_module);
+            #endif
+            overlay_slots[prefetch_slot].module = prefetch_module;
+            overlay_slots[prefetch_slot].used = overlay_clock;
+            ++overlay_prefetches;
+        }
+        prefetch_module = 0;
+    }
+
+    /**
+     * This function starts to load the first module asked for: from the
+     * caches, if it is present into one of them, otherwise from the mass
+     * storage.
+     */
+    static void prefetch_begin(void)
+    {
+        unsigned char module = prefetch_queue[0];
+        unsigned char i;
+        #ifndef __COMPRESS__
+        unsigned char result;
+        #endif
+
+        for (i = 1; i < OVERLAY_SLOTS; ++i) {
+            prefetch_queue[i - 1] = prefetch_queue[i];
+        }
+        prefetch_queue[OVERLAY_SLOTS - 1] = 0;
+
+        if (find_overlay(module) < OVERLAY_SLOTS) {
+            return;
+        }
+        prefetch_slot = choose_overlay(&overlay_modules[module - 1]);
+        #ifdef __RELOCATE__
+        // There is no room for it, unless the running module is removed.
+        if (prefetch_slot == OVERLAY_SLOTS) {
+            return;
+        }
+        #endif
+        prefetch_module = module;
+        overlay_slots[prefetch_slot].module = 0;
+        #ifdef __OVERLAY_STATS__
+        overlay_transferred = 0;
+        #endif
+
+        #ifdef OVERLAY_REU
+        if (reu_load(module)) {
+            prefetch_end(1);
+            return;
+        }
+        #endif
+        #ifdef OVERLAY_HIRAM
+        if (hiram_load(module)) {
+            prefetch_end(1);
+            return;
+        }
+        #endif
+        #ifdef OVERLAY_VICRAM
+        if (vicram_load(module)) {
+            prefetch_end(1);
+            return;
+        }
+        #endif
+        // The load from the mass storage is counted as the ones made on 
+        // demand; its jiffies only if the program has to wait for it (see
+        // require_overlay()).
+        #ifdef __OVERLAY_STATS__
+        ++overlay_statistics[module - 1].loads;
+        #endif
+        prefetch_mark();
+        #ifdef __COMPRESS__
+        if (!overlay_open(module)) {
+            prefetch_count();
+            prefetch_end(0);
+            return;
+        }
+        unpack_start();
+        overlay_suspend();
+        prefetch_count();
+        #else
+        result = load_overlay(module);
+        prefetch_count();
+        prefetch_end(result);
+        #endif
+    }
+
+    /**
+     * This function stops the loading in the background, if any: the 
+     * module is completed if "complete" is not 0, otherwise it is 
+     * abandoned (and its slot is left empty).
+     */
+    static void prefetch_stop(unsigned char complete)
+    {
+        #ifdef __COMPRESS__
+        unsigned char result = UNPACK_ERROR;
+
+        if (prefetch_module == 0) {
+            return;
+        }
+        prefetch_mark();
+        overlay_resume();
+        if (complete) {
+            while ((result = unpack_step(0)) == UNPACK_MORE) ;
+        }
+        overlay_close();
+        prefetch_count();
+        prefetch_end(result == UNPACK_DONE);
+        #else
+        (void)complete;
+        #endif
+    }
+
+    /**
+     * This function does a small piece of the work in the background: it
+     * must be called again and again while the program is idle.
+     */
+    void overlay_idle(void)
+    {
+        #ifdef __COMPRESS__
+        unsigned char result;
+
+        if (prefetch_module != 0) {
+            prefetch_mark();
+            overlay_resume();
+            result = unpack_step(PREFETCH_TOKENS);
+            if (result == UNPACK_MORE) {
+                overlay_suspend();
+                prefetch_count();
+                return;
+            }
+            overlay_close();
+            prefetch_count();
+            prefetch_end(result == UNPACK_DONE);
+            return;
+        }
+        #endif
+        if (prefetch_queue[0] != 0) {
+            prefetch_begin();
+        }
+    }
+
+    #endif
+
+    #ifdef __OVERLAY_STACK__
+
+    /************************************************************************
+     ** STACK MEASURE SECTION
+     ************************************************************************/
+
+    // The debug build (see STACKCHECK into the makefile) measures how deep 
+    // the C stack goes. The stack grows downwards from the start of the 
+    // overlay area: the free memory between the end of the BSS and the part 
+    // of the stack in use is painted with STACK_CANARY at startup, so the 
+    // lowest byte that has been changed tells the deepest use. The memory is 
+    // measured (and painted again) every time a module is required, and the 
+    // use is charged to the module required the time before, that has been 
+    // running meanwhile (with the resident functions it called). The result 
+    // is a bit in excess, since the functions that measure are counted too.
+    extern char _BSS_RUN__[], _BSS_SIZE__[];
+    extern char _OVERLAYSTART__[], _STACKSIZE__[];
+
+    #define STACK_CANARY    0xa5
+
+    // Bytes below the local variable of the painting function that are 
+    // not painted, since they could be in use.
+    #define STACK_GUARD     16
+
+    // Deepest use of the stack so far, and the module that is running.
+    static unsigned int stack_deepest;
+    static unsigned char stack_module;
+
+    /**
+     * This function paints the free memory below the stack in use.
+     */
+    void overlay_stack_paint(void)
+    {
+        unsigned char here;
+        unsigned char* end = &here - STACK_GUARD;
+        unsigned char* p = (unsigned char*)_BSS_RUN__ + (unsigned int)_BSS_SIZE__;
+
+        while (p < end) {
+            *p++ = STACK_CANARY;
+        }
+    }
+
+    /**
+     * This function charges the deepest use of the stack since the last time
+     * to the module that was running, and it starts to measure for the 
+     * module number "module".
+     */
+    static void stack_sample(unsigned char module)
+    {
+        unsigned char* p = (unsigned char*)_BSS_RUN__ + (unsigned int)_BSS_SIZE__;
+        unsigned int depth;
+
+        while (p < (unsigned char*)_OVERLAYSTART__ && *p == STACK_CANARY) {
+            ++p;
+        }
+        depth = (unsigned char*)_OVERLAYSTART__ - p;
+        overlay_stack_paint();
+
+        if (depth > stack_deepest) {
+            stack_deepest = depth;
+        }
+        if (stack_module != 0 && depth > overlay_statistics[stack_module - 1].stack) {
+            overlay_statistics[stack_module - 1].stack = depth;
+        }
+        stack_module = module;
+    }
+
+    #endif
+
+    /**
+     * This function makes sure that the module number "module" is present
+     * into one of the overlay slots. If it is already there, it returns at
+     * once (and it counts an "hit"); otherwise it loads the module from the
+     * caches or from the mass storage, replacing the module into its slot
+     * (or, if the modules are relocatable, the least recently used ones) 
+     * and it counts a "miss".
+     * It returns 0 if any error occours.
+     */
+    unsigned char require_overlay(unsigned char module)
+    {
+        const overlay_module* descriptor;
+        unsigned char slot;
+        #if defined(__PREFETCH__) && defined(__OVERLAY_STATS__)
+        clock_t start;
+        #endif
+
+        ++overlay_clock;
+
+        #ifdef __OVERLAY_STACK__
+        stack_sample(module);
+        #endif
+
+        #ifdef OVERLAY_REU
+        if (reu_status == REU_UNKNOWN) {
+            reu_fill();
+        }
+        #endif
+
+        #ifdef __PREFETCH__
+        // The requests of modules are valid only while waiting for a key.
+        // If the module is being loaded in the background, only the rest 
+        // of it has to be waited for.
+        memset(prefetch_queue, 0, sizeof(prefetch_queue));
+        if (module == prefetch_module) {
+            #ifdef __OVERLAY_STATS__
+            start = clock();
+            prefetch_stop(1);
+            overlay_statistics[module - 1].jiffies += clock() - start;
+            #else
+            prefetch_stop(1);
+            #endif
+        }
+        #endif
+
+        descriptor = &overlay_modules[module - 1];
+
+        slot = find_overlay(module);
+        if (slot < OVERLAY_SLOTS) {
+            overlay_slots[slot].used = overlay_clock;
+            ++overlay_hits;
+            #ifdef __RELOCATE__
+            overlay_base = heap_address(descriptor, overlay_slots[slot].page);
+            heap_keep = module;
+            #endif
+            #if defined(__CBM__) && defined(__OVERLAY_PROFILE__)
+            overlay_mark(module);
+            #endif
+            return 1;
+        }
+
+        ++overlay_misses;
+
+        #ifdef __PREFETCH__
+        // The mass storage must be free: the module being loaded in the
+        // background is completed, unless it would be replaced at once 
+        // (relocatable modules could fit both).
+        if (prefetch_module != 0) {
+            #ifdef __RELOCATE__
+            prefetch_stop(1);
+            #else
+            prefetch_stop(!(overlay_modules[prefetch_module - 1].slots & descriptor->slots));
+            #endif
+        }
+        #endif
+
+        slot = choose_overlay(descriptor);
+
+        #ifdef __RELOCATE__
+        if (slot == OVERLAY_SLOTS) {
+            write_line("Out of memory - memoria esaurita.");
+            return 0;
+        }
+        #endif
+
+        // The slot will be overwritten, even partially: so we forget the
+        // module that was there before, in order to avoid to consider it
+        // valid if the loading fails. Note that, unless the modules are 
+        // relocatable, a module can be placed only into its slot, since it
+        // is linked at a fixed address.
+        overlay_slots[slot].module = 0;
+
+        if (!fetch_overlay(module)) {
+            return 0;
+        }
+
+        overlay_slots[slot].module = module;
+        overlay_slots[slot].used = overlay_clock;
+        #ifdef __RELOCATE__
+        overlay_base = relocate_base;
+        heap_keep = module;
+        #endif
+        #if defined(__CBM__) && defined(__OVERLAY_PROFILE__)
+        overlay_mark(module);
+        #endif
+        return 1;
+    }
+
+    /**
+     * This function is called by the trampolines before calling a function
+     * of the module number "module": the module is pushed on the return 
+     * stack, and it is made present.
+     * It returns 0 if any error occours (the module is not pushed then).
+     */
+    unsigned char overlay_call(unsigned char module)
+    {
+        if (overlay_depth == OVERLAY_DEPTH) {
+            write_line("Too many calls - troppe chiamate.");
+            return 0;
+        }
+        overlay_stack[overlay_depth++] = module;
+        if (!require_overlay(module)) {
+            --overlay_depth;
+            return 0;
+        }
+        return 1;
+    }
+
+    /**
+     * This function is called by the trampolines when a function returns: 
+     * its module is removed from the return stack, and the module of the 
+     * caller (if any) is made present again.
+     */
+    void overlay_return(void)
+    {
+        --overlay_depth;
+        if (overlay_depth != 0) {
+            // There is no way to go on without the caller: the load is 
+            // tried again until it succeeds (the error has been already 
+            // written by the overlay manager).
+            while (!require_overlay(overlay_stack[overlay_depth - 1])) {
+                press_any_key();
+            }
+        }
+    }
+
+    #ifdef __OVERLAY_STATS__
+
+    /************************************************************************
+     ** OVERLAY STATISTICS SECTION
+     ************************************************************************/
+
+    // Counters of each module, updated by fetch_overlay() every time the 
+    // module is read from the mass storage (and not from the caches). Note 
+    // that the KERNAL disables the interrupts while a byte is moving on the 
+    // serial bus, so the jiffies of the loads made by the KERNAL routines 
+    // are a bit less than the real ones.
+    overlay_stats overlay_statistics[OVERLAY_MODULES];
+
+    // Bytes read from the mass storage by the current load.
+    unsigned int overlay_transferred;
+
+    // Logical file number, secondary address and name of the file where the
+    // counters are written.
+    #define STATS_LFN       3
+    #define STATS_SA        3
+    #define STATS_FILE      "@0:demo.stats,s,w"
+
+    // The line that is being written, its length and the logical file 
+    // where it will be written (0 = screen).
+    static char stats_line[48];
+    static unsigned char stats_length;
+    static unsigned char stats_file;
+
+    /**
+     * This function appends the string "text" to the current line.
+     */
+    static void stats_text(const char* text)
+    {
+        while (*text) {
+            stats_line[stats_length++] = *text++;
+        }
+    }
+
+    /**
+     * This function appends the decimal representation of "number" to the
+     * current line.
+     */
+    static void stats_number(unsigned long number)
+    {
+        ultoa(number, stats_line + stats_length, 10);
+        stats_length += strlen(stats_line + stats_length);
+    }
+
+    /**
+     * This function writes the current line on the screen or into the 
+     * file, and it starts a new one.
+     */
+    static void stats_flush(void)
+    {
+        #ifdef __CBM__
+        if (stats_file) {
+            stats_line[stats_length++] = '\n';
+            cbm_write(stats_file, stats_line, stats_length);
+            stats_length = 0;
+            return;
+        }
+        #endif
+        stats_line[stats_length] = 0;
+        write_line(stats_line);
+        stats_length = 0;
+    }
+
+    /**
+     * This function writes all the counters: a line for each module (loads,
+     * bytes, jiffies and, if measured, the deepest use of the stack), the
+     * hits and the misses of the overlay manager (and the modules loaded in
+     * the background), the total time spent waiting for the mass storage
+     * and, if measured, the deepest use of the stack by all the modules.
+     */
+    static void stats_write(void)
+    {
+        const overlay_stats* stats = overlay_statistics;
+        unsigned long wait = 0;
+        unsigned char i;
+
+        #ifdef __OVERLAY_STACK__
+        stack_sample(stack_module);
+        #endif
+
+        for (i = 0; i < OVERLAY_MODULES; ++i, ++stats) {
+            stats_text(overlay_modules[i].name);
+            stats_text(" L");
+            stats_number(stats->loads);
+            stats_text(" B");
+            stats_number(stats->bytes);
+            stats_text(" J");
+            stats_number(stats->jiffies);
+            #ifdef __OVERLAY_BENCH__
+            stats_text(" C");
+            stats_number(stats->cycles);
+            #endif
+            #ifdef __OVERLAY_STACK__
+            stats_text(" S");
+            stats_number(stats->stack);
+            #endif
+            stats_flush();
+            wait += stats->jiffies;
+        }
+        stats_text("HIT ");
+        stats_number(overlay_hits);
+        stats_text(" MISS ");
+        stats_number(overlay_misses);
+        #ifdef __PREFETCH__
+        stats_text(" PREFETCH ");
+        stats_number(overlay_prefetches);
+        #endif
+        stats_flush();
+        stats_text("WAIT J");
+        stats_number(wait);
+        stats_flush();
+        #ifdef __OVERLAY_STACK__
+        // Deepest use of the stack, and its size into the linker 
+        // configuration.
+        stats_text("STACK U");
+        stats_number(stack_deepest);
+        stats_text(" R");
+        stats_number((unsigned int)_STACKSIZE__);
+        stats_flush();
+        #endif
+        #ifdef __OVERLAY_BENCH__
+        // Cycles elapsed since the reset, loading of the program included.
+        stats_text("SESSION C");
+        stats_number(overlay_cycles());
+        stats_flush();
+        #endif
+    }
+
+    /**
+     * This function prints out the counters on the screen.
+     */
+    void overlay_dump(void)
+    {
+        stats_file = 0;
+        stats_write();
+    }
+
+    #ifdef __CBM__
+
+    /**
+     * This function writes the counters into a sequential file on the disk
+     * (replacing the previous one). Since the KERNAL routines are needed, 
+     * the drive is given back to the DOS: the fast-loader cannot be 
+     * installed again, so the following loads will be slower.
+     * It returns 0 if any error occours.
+     */
+    unsigned char overlay_save(void)
+    {
+        #ifdef __PREFETCH__
+        prefetch_stop(0);
+        #endif
+        #ifdef __FASTLOAD__
+        fastload_exit();
+        #endif
+        if (cbm_open(STATS_LFN, getcurrentdevice(), STATS_SA, STATS_FILE) != 0) {
+            return 0;
+        }
+        stats_file = STATS_LFN;
+        stats_write();
+        stats_file = 0;
+        cbm_close(STATS_LFN);
+        return 1;
+    }
+
+    #endif
+
+    #ifdef __OVERLAY_BENCH__
+
+    // The cycles are counted by the timer that gives the jiffies to the 
+    // KERNAL: they are the jiffies multiplied by the period of the timer, 
+    // plus the cycles elapsed since its last underflow (it counts down). 
+    // The benchmark build also uses the "debug cartridge" of VICE: the 
+    // emulator exits, with the value written into its register.
+    #ifdef __C64__
+        // CIA 1 timer A. Its value at the underflow cannot be read from 
+        // the CIA: it is the one written by the KERNAL at reset, for a PAL 
+        // or for a NTSC machine.
+        #define BENCH_TIMER     ((volatile unsigned char*)0xdc04)
+        #define BENCH_LATCH     (*(unsigned char*)0x02a6 ? 0x4025 : 0x4295)
+        #define BENCH_EXTRA     1
+        #define BENCH_EXIT      (*(unsigned char*)0xd7ff)
+    #else
+        // VIA 2 timer 1, whose value at the underflow can be read.
+        #define BENCH_TIMER     ((volatile unsigned char*)0x9124)
+        #define BENCH_LATCH     (*(unsigned int*)0x9126)
+        #define BENCH_EXTRA     2
+        #define BENCH_EXIT      (*(unsigned char*)0x910f)
+    #endif
+
+    /**
+     * This function returns the number of cycles elapsed since the reset.
+     */
+    unsigned long overlay_cycles(void)
+    {
+        unsigned int latch = BENCH_LATCH;
+        unsigned long jiffies;
+        unsigned char high;
+        unsigned char low;
+
+        // If the timer underflows while it is read, the interrupt changes
+        // the jiffies or the high byte changes: so it is read again.
+        do {
+            jiffies = clock();
+            do {
+                high = BENCH_TIMER[1];
+                low = BENCH_TIMER[0];
+            } while (high != BENCH_TIMER[1]);
+        } while (jiffies != clock());
+
+        return jiffies * (latch + BENCH_EXTRA) + (latch - ((high << 8) | low));
+    }
+
+    /**
+     * This function ends the benchmark: the emulator exits with 0 if the 
+     * counters have been saved ("saved" is not zero), otherwise with 1.
+     */
+    void overlay_bench_exit(unsigned char saved)
+    {
+        BENCH_EXIT = saved ? 0 : 1;
+    }
+
+    #endif
+
+    #endif
+
+#endif
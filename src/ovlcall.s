@@ -0,0 +1,216 @@
+; /****************************************************************************
+;  * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+;  *                                                                          *
+;  * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+;  *--------------------------------------------------------------------------*
+;  * OVERLAY CALL-THROUGH SUPPORT (RESIDENT MODULE)                           *
+;  ****************************************************************************/
+
+; This is the resident part shared by all the trampolines generated by the
+; "ovlstub" tool. Every trampoline loads the number of the module into the
+; Y register and calls "ovlenter": this routine asks the overlay manager to
+; push the module on the return stack and to make it resident, taking care
+; of preserving the A and X registers and "sreg" (they could contain the 
+; last parameter of the function called, according to the cc65 calling 
+; convention: "sreg" is the high word of a long one). The parameters passed
+; on the C stack are not touched at all.
+;
+; The address where the function will return is kept on the return stack
+; too (see overlay_returns into main.h), and it is replaced by the one of
+; "ovlreturn": when the function returns, the overlay manager makes present
+; the module of the caller again, since the function could have replaced it
+; (by calling a function of another module, that lives into the same slot).
+; Then the caller is reached through the address that was kept, preserving
+; the result of the function (A, X and "sreg").
+;
+; When the modules are relocatable (__RELOCATE__), a module can be loaded
+; anywhere into the overlay area: each trampoline puts the number of the
+; function into "ovlindex" and jumps to "ovljump", that takes the address
+; of the function from the header of the module (a table of addresses, at
+; its beginning) and jumps there. The function returns to "ovlreturn" as
+; well.
+;
+; The profile build (__OVERLAY_PROFILE__) marks every module that is made
+; present into the overlay area, by calling "overlay_mark" (see below).
+
+        .export     ovlenter
+        .import     _overlay_call, _overlay_return
+        .import     _overlay_depth, _overlay_returns
+        .importzp   sreg
+
+.ifdef __RELOCATE__
+        .export     ovljump, ovlindex
+        .import     _overlay_base
+        .importzp   ptr1
+.endif
+
+.ifdef __OVERLAY_PROFILE__
+        .export     _overlay_mark, ovlmarks
+.endif
+
+;------------------------------------------------------------------------------
+
+.segment "BSS"
+
+save_a: .res    1
+save_x: .res    1
+save_s: .res    2
+
+.ifdef __RELOCATE__
+ovlindex:
+        .res    1
+.endif
+
+;------------------------------------------------------------------------------
+
+; The address where the function returns (minus one) is the one that the
+; caller of the trampoline pushed on the stack: "offset" is its position,
+; starting from the stack pointer. It is moved to the top of the return 
+; stack (the module has just been pushed there), and "ovlreturn" is put 
+; in its place.
+
+.macro  intercept offset
+        lda     _overlay_depth
+        asl     a
+        tay
+        tsx
+        lda     $0100+offset,x
+        sta     _overlay_returns-2,y
+        lda     $0100+offset+1,x
+        sta     _overlay_returns-1,y
+        lda     #<(ovlreturn - 1)
+        sta     $0100+offset,x
+        lda     #>(ovlreturn - 1)
+        sta     $0100+offset+1,x
+.endmacro
+
+;------------------------------------------------------------------------------
+
+.segment "CODE"
+
+ovlenter:
+        sta     save_a
+        stx     save_x
+        lda     sreg
+        sta     save_s
+        lda     sreg+1
+        sta     save_s+1
+        tya
+        jsr     _overlay_call
+        tax
+        beq     fail
+        intercept 3
+        lda     save_s
+        sta     sreg
+        lda     save_s+1
+        sta     sreg+1
+        lda     save_a
+        ldx     save_x
+        rts
+
+; If the module cannot be loaded, we must not jump into the overlay area.
+; So we drop the return address into the trampoline: the next "rts" will
+; return directly to the caller, as if the function had been called (the
+; error message has been already printed by the overlay manager).
+
+fail:   pla
+        pla
+        rts
+
+; The function returned: its module is removed from the return stack, and
+; the module of the caller is made present. The address where the caller 
+; returns (minus one) is taken from the return stack, and pushed on the 
+; stack, so that "rts" jumps there.
+
+ovlreturn:
+        sta     save_a
+        stx     save_x
+        lda     sreg
+        sta     save_s
+        lda     sreg+1
+        sta     save_s+1
+        jsr     _overlay_return
+        lda     _overlay_depth
+        asl     a
+        tay
+        lda     _overlay_returns+1,y
+        pha
+        lda     _overlay_returns,y
+        pha
+        lda     save_s
+        sta     sreg
+        lda     save_s+1
+        sta     sreg+1
+        ldx     save_x
+        lda     save_a
+        rts
+
+.ifdef __RELOCATE__
+
+; The address of the function (minus one) is pushed on the stack, so that
+; "rts" jumps there. If the module cannot be loaded, "rts" returns to the
+; caller of the trampoline at once.
+
+ovljump:
+        sta     save_a
+        stx     save_x
+        lda     sreg
+        sta     save_s
+        lda     sreg+1
+        sta     save_s+1
+        tya
+        jsr     _overlay_call
+        tax
+        beq     jump
+        intercept 1
+        lda     _overlay_base
+        sta     ptr1
+        lda     _overlay_base+1
+        sta     ptr1+1
+        lda     ovlindex
+        asl     a
+        tay
+        lda     (ptr1),y
+        sec
+        sbc     #1
+        tax
+        iny
+        lda     (ptr1),y
+        sbc     #0
+        pha
+        txa
+        pha
+        lda     save_s
+        sta     sreg
+        lda     save_s+1
+        sta     sreg+1
+        lda     save_a
+        ldx     save_x
+jump:   rts
+
+.endif
+
+.ifdef __OVERLAY_PROFILE__
+
+; The module number "module" (into A) is marked by jumping to the byte with
+; the same number of "ovlmarks", a table of "rts": the profiler ("ovlprof")
+; finds the address of that byte into the trace of the emulator, and so it
+; knows which module is present. The address of the byte (minus one) is 
+; pushed on the stack, as by "ovljump". There is a byte for each module 
+; (see OVERLAY_MODULES into main.h), and some to spare.
+
+_overlay_mark:
+        clc
+        adc     #<(ovlmarks - 1)
+        tax
+        lda     #>(ovlmarks - 1)
+        adc     #0
+        pha
+        txa
+        pha
+        rts
+
+ovlmarks:
+        .res    32, $60
+
+.endif
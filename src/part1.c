@@ -48,7 +48,7 @@ extern int language;
 /**
  * This function print the first "canto" of Divine Comedy.
  */
-void canto1(void)
+void OVERLAYED(canto1)(void)
 {
     write_title("CANTO I");
     if (language == 0) {
@@ -47,7 +47,7 @@ extern int language;
 /**
  * This function print the second "canto" of Divine Comedy.
  */
-void canto2(void)
+void OVERLAYED(canto2)(void)
 {
     write_title("CANTO II");
     if (language == 0) {
@@ -48,25 +48,25 @@ extern int language;
 /**
  * This function print the title of the Divine Comedy
  */
-void presentation(void)
+void OVERLAYED(presentation)(void)
 {
-    puts(" LA DIVINA COMMEDIA");
-    puts("  di Dante Alighieri");
-    puts(" ");
+    write_line(" LA DIVINA COMMEDIA");
+    write_line("  di Dante Alighieri");
+    write_line(" ");
 }
 
 /**
  * This function allows to choose the language (italian / english)
  */
-void choose_language(void)
+void OVERLAYED(choose_language)(void)
 {
     int c;
 
     do {
-        puts("Which language?");
-        puts("  0) italiano");
-        puts("  1) inglese");
-        c = getchar();
+        write_line("Which language?");
+        write_line("  0) italiano");
+        write_line("  1) inglese");
+        c = wait_key();
         if (c == '0') {
             language = 0;
             break;
@@ -75,9 +75,9 @@ void choose_language(void)
             language = 1;
             break;
         }
-        puts("");
-        puts("Please digit 0 for italian or 1 for english.");
-        puts("");
+        write_line("");
+        write_line("Please digit 0 for italian or 1 for english.");
+        write_line("");
     } while (1); // Repeat until a choice has been taken
 
 }
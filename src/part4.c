@@ -49,27 +49,50 @@ extern int canto;
 /**
  * This function allow the user to choose the "canto" to be displayed
  */
-void choose_canto(void)
+void OVERLAYED(choose_canto)(void)
 {
     int c;
 
     do {
-        puts("");
+        write_line("");
         if (language == 0) {
-            puts("Quale canto?");
+            write_line("Quale canto?");
         }
         else {
-            puts("Which canto?");
+            write_line("Which canto?");
         }
-        puts("  1) CANTO I");
-        puts("  2) CANTO II");
+        write_line("  1) CANTO I");
+        write_line("  2) CANTO II");
         if (language == 0) {
-            puts("  Q) Esci");
+            write_line("  L) Lingua");
         }
         else {
-            puts("  Q) Quit");
+            write_line("  L) Language");
         }
-        c = getchar();
+        #if defined(__OVERLAY__) && defined(__OVERLAY_STATS__)
+        if (language == 0) {
+            write_line("  S) Statistiche");
+        }
+        else {
+            write_line("  S) Statistics");
+        }
+        #endif
+        if (language == 0) {
+            write_line("  Q) Esci");
+        }
+        else {
+            write_line("  Q) Quit");
+        }
+        #if defined(__OVERLAY__) && defined(__PREFETCH__)
+        // While the user reads the menu, the "canto" that follows the last
+        // one read is loaded in the background (its text first). The slot 
+        // of this menu is left alone.
+        #ifdef __PACKTEXT__
+        prefetch_overlay(TEXT_MODULE(canto % 2 + 1, language), OVERLAY_MODULE4);
+        #endif
+        prefetch_overlay(OVERLAY_MODULE1 + canto % 2, OVERLAY_MODULE4);
+        #endif
+        c = wait_key();
         if (c == '1') {
             canto = 1;
             break;
@@ -82,15 +105,27 @@ void choose_canto(void)
             canto = 0;
             break;
         }
+        else if (c == 'L' || c == 'l') {
+            // The menu of module 3: on return, this module is made present
+            // again (they share the same slot).
+            choose_language();
+        }
+        #if defined(__OVERLAY__) && defined(__OVERLAY_STATS__)
+        else if (c == 'S' || c == 's') {
+            // The counters of the overlay manager (see overlay.c).
+            overlay_dump();
+            press_any_key();
+        }
+        #endif
         else {
-            puts("");
+            write_line("");
             if (language == 0) {
-                puts("Digitare 1 per CANTO I o 2 per CANTO II.");
+                write_line("Digitare 1 per CANTO I o 2 per CANTO II.");
             }
             else {
-                puts("Please digit 1 for CANTO I or 2 for CANTO II.");
+                write_line("Please digit 1 for CANTO I or 2 for CANTO II.");
             }
-            puts("");
+            write_line("");
         }
     } while (1); // Repeat until a choice has been taken
 }
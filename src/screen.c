@@ -0,0 +1,188 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * SCREEN RENDERER (RESIDENT MODULE)                                        *
+ ****************************************************************************/
+
+/****************************************************************************
+ ** INCLUDE SECTION
+ ****************************************************************************/
+
+#include <string.h>
+
+#include "main.h"
+
+// The renderer is available only on Commodore targets, and only if it has
+// been enabled at compile time by defining the __SCREEN__ symbol (see the
+// makefile). Otherwise, the text is written by the standard library.
+//
+// The text is written straight into the screen memory and into the colour
+// memory, a line at a time, without going through the KERNAL: lines longer
+// than the screen are wrapped at the last blank that fits (the following
+// rows are indented by one character). The renderer keeps its own cursor,
+// since it is the only one that writes on the screen.
+
+#if defined(__CBM__) && defined(__SCREEN__)
+
+/****************************************************************************
+ ** DEFINITIONS SECTION
+ ****************************************************************************/
+
+// Page of the screen memory, as set by the KERNAL, current colour of the
+// text and row of the KERNAL cursor (the same on both the C64 and the
+// VIC-20).
+#define HIBASE                  (*(unsigned char*)0x0288)
+#define COLOR                   (*(unsigned char*)0x0286)
+#define TBLX                    (*(unsigned char*)0x00d6)
+
+// Size of the screen, and position of the colour memory. On the VIC-20 the
+// colour memory follows the screen memory: bit 7 of the register 2 of the
+// VIC is the bit 9 of the address of both.
+#ifdef __C64__
+    #define SCREEN_WIDTH        40
+    #define SCREEN_HEIGHT       25
+    #define COLOR_RAM           ((unsigned char*)0xd800)
+#else
+    #define SCREEN_WIDTH        22
+    #define SCREEN_HEIGHT       23
+    #define COLOR_RAM           ((unsigned char*)(0x9400 | ((*(unsigned char*)0x9002 & 0x80) << 2)))
+#endif
+
+#define SCREEN_SIZE             (SCREEN_WIDTH * SCREEN_HEIGHT)
+
+// The screen code of the blank.
+#define SCREEN_BLANK            0x20
+
+// The row of the cursor is not known yet.
+#define SCREEN_UNKNOWN          0xff
+
+/****************************************************************************
+ ** VARIABLES SECTION
+ ****************************************************************************/
+
+// Offset of each row from the beginning of the screen.
+#define ROW(n)                  ((n) * SCREEN_WIDTH)
+
+static const unsigned int screen_rows[SCREEN_HEIGHT] = {
+    ROW(0),  ROW(1),  ROW(2),  ROW(3),  ROW(4),  ROW(5),  ROW(6),  ROW(7),
+    ROW(8),  ROW(9),  ROW(10), ROW(11), ROW(12), ROW(13), ROW(14), ROW(15),
+    ROW(16), ROW(17), ROW(18), ROW(19), ROW(20), ROW(21), ROW(22)
+#ifdef __C64__
+    , ROW(23), ROW(24)
+#endif
+};
+
+// Row where the next line will be written. At the beginning, it is the
+// row of the KERNAL cursor (below the command that started the program).
+static unsigned char screen_row = SCREEN_UNKNOWN;
+
+/****************************************************************************
+ ** FUNCTIONS SECTION
+ ****************************************************************************/
+
+/**
+ * This function converts the PETSCII character "c" into its screen code.
+ * Control characters must not be passed.
+ */
+static unsigned char screen_code(unsigned char c)
+{
+    if (c < 0x40) {
+        return c;
+    } else if (c < 0x60) {
+        return c - 0x40;
+    } else if (c < 0x80) {
+        return c - 0x20;
+    } else if (c < 0xc0) {
+        return c - 0x40;
+    } else if (c == 0xff) {
+        return 0x5e;
+    }
+    return c - 0x80;
+}
+
+/**
+ * This function moves the whole screen up by one row, and it clears the
+ * last one.
+ */
+static void screen_scroll(void)
+{
+    unsigned char* screen = (unsigned char*)(HIBASE << 8);
+    unsigned char* color = COLOR_RAM;
+
+    memmove(screen, screen + SCREEN_WIDTH, SCREEN_SIZE - SCREEN_WIDTH);
+    memmove(color, color + SCREEN_WIDTH, SCREEN_SIZE - SCREEN_WIDTH);
+    memset(screen + ROW(SCREEN_HEIGHT - 1), SCREEN_BLANK, SCREEN_WIDTH);
+    memset(color + ROW(SCREEN_HEIGHT - 1), COLOR, SCREEN_WIDTH);
+}
+
+/**
+ * This function clears the screen, and it puts the cursor on the first row.
+ */
+void screen_clear(void)
+{
+    memset((unsigned char*)(HIBASE << 8), SCREEN_BLANK, SCREEN_SIZE);
+    memset(COLOR_RAM, COLOR, SCREEN_SIZE);
+    screen_row = 0;
+}
+
+/**
+ * This function writes the (PETSCII) string "text" as a line, starting
+ * from the row of the cursor: then, the cursor goes on the following row.
+ * The screen is scrolled when the cursor goes beyond its last row.
+ */
+void screen_line(const char* text)
+{
+    unsigned char* screen;
+    unsigned char* color;
+    unsigned char length = (unsigned char)strlen(text);
+    unsigned char indent = 0;
+    unsigned char count;
+    unsigned char c;
+    unsigned char i;
+
+    if (screen_row == SCREEN_UNKNOWN) {
+        screen_row = TBLX;
+    }
+
+    do {
+        // The part that fits into the row is cut at its last blank (if
+        // any), when the line goes on.
+        count = SCREEN_WIDTH - indent;
+        if (length > count) {
+            for (i = count; i > 0 && text[i] != ' '; --i) ;
+            if (i > 0) {
+                count = i;
+            }
+        } else {
+            count = length;
+        }
+
+        if (screen_row >= SCREEN_HEIGHT) {
+            screen_scroll();
+            screen_row = SCREEN_HEIGHT - 1;
+        }
+        screen = (unsigned char*)(HIBASE << 8) + screen_rows[screen_row] + indent;
+        color = COLOR_RAM + screen_rows[screen_row] + indent;
+        for (i = 0; i < count; ++i) {
+            c = (unsigned char)text[i];
+            if ((c & 0x7f) >= 0x20) {
+                *screen++ = screen_code(c);
+                *color++ = COLOR;
+            }
+        }
+        text += count;
+        length -= count;
+
+        // The blank where the line has been cut is not written.
+        if (length > 0 && *text == ' ') {
+            ++text;
+            --length;
+        }
+        indent = 1;
+        ++screen_row;
+    } while (length > 0);
+}
+
+#endif
@@ -0,0 +1,238 @@
+; /****************************************************************************
+;  * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+;  *                                                                          *
+;  * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+;  *--------------------------------------------------------------------------*
+;  * TURBO TAPE LOADER (RESIDENT MODULE)                                      *
+;  ****************************************************************************/
+
+; The overlayed executable for tapes (see the "c64tap" target of the
+; makefile) is loaded by the KERNAL routines, and the modules follow it on
+; the tape, written by the "ovltape" tool in the order they are expected to
+; be loaded (see tools/ovltape.c for the format). This is the routine that
+; brings a module into its slot: it starts the motor and it reads the blocks
+; that follow, skipping the ones of the other modules, until the module is
+; found. Then the motor is stopped, so the tape is left just after it.
+;
+; Each bit is a pulse: the timer B of the CIA 2 is started on each pulse (the
+; FLAG line of the CIA 1 tells that it arrived), so it has run out at the
+; next one only if the pulse is longer than THRESHOLD cycles (a 1). The
+; interrupts are disabled meanwhile, and the screen is blanked, since the
+; VIC-II would steal the cycles of the CPU at random. The clock of the
+; KERNAL is stopped as well.
+;
+; The tape is expected to be moved only by this loader (and rewound by the
+; user, when asked to): so a block is looked for just after the previous
+; one, or at the beginning of the tape, where the pulses of the program
+; loaded by the KERNAL do not look like the ones of a block.
+
+.if .defined(__C64__) .and .defined(__TAPE__)
+
+        .export     _tape_load, _tape_size
+        .importzp   ptr1, ptr2, tmp1, tmp2, tmp3
+
+;------------------------------------------------------------------------------
+
+; Port of the CPU: motor of the datasette (0 = on) and PLAY key (0 = down).
+; The KERNAL leaves the motor alone if its interlock is set.
+CPU_PORT    = $01
+MOTOR_OFF   = $20
+INTERLOCK   = $C0
+
+; CIA 1: the FLAG line is the input of the datasette, and the RUN/STOP key.
+ICR1        = $DC0D
+FLAG        = $10
+KEY_COLUMN  = $DC00
+KEY_ROW     = $DC01
+
+; CIA 2: timer B, one shot, started (and loaded) on each pulse.
+TIMER_B     = $DD06
+ICR2        = $DD0D
+CRB2        = $DD0F
+ONE_SHOT    = $19
+
+; Control register of the VIC-II, and its bit that shows the screen.
+VIC_CTRL    = $D011
+SCREEN_ON   = $10
+
+; Pulses longer than this (in cycles) are a 1 (see tools/ovltape.c).
+THRESHOLD   = 263
+
+; Pilot and sync bytes of each block.
+PILOT       = $02
+SYNC        = $09
+
+; Result of the load (see TAPE_OK into main.h).
+TAPE_OK     = 0
+TAPE_END    = 1
+TAPE_ERROR  = 2
+
+;------------------------------------------------------------------------------
+
+.segment "BSS"
+
+; Bytes of the module loaded last.
+_tape_size:
+        .res    2
+
+;------------------------------------------------------------------------------
+
+.segment "CODE"
+
+; unsigned char tape_load(unsigned char module);
+;
+; Load the module number "module" from the blocks that follow on the tape.
+; It returns TAPE_OK, TAPE_END if the end of the tape has been found first,
+; or TAPE_ERROR if the module has not been read correctly (or RUN/STOP has
+; been pressed).
+
+_tape_load:
+        sta     tmp2
+        sei
+        lda     #$7F
+        sta     ICR2
+        lda     #<THRESHOLD
+        sta     TIMER_B
+        lda     #>THRESHOLD
+        sta     TIMER_B+1
+        lda     VIC_CTRL
+        and     #<~SCREEN_ON
+        sta     VIC_CTRL
+        lda     CPU_PORT
+        and     #<~MOTOR_OFF
+        sta     CPU_PORT
+        lda     ICR1
+
+; Each block tells the module, the address where it is loaded and its size.
+
+block:  jsr     sync
+        bcs     stop
+        jsr     readbyte
+        sta     tmp3
+        jsr     readbyte
+        sta     ptr1
+        jsr     readbyte
+        sta     ptr1+1
+        jsr     readbyte
+        sta     ptr2
+        jsr     readbyte
+        sta     ptr2+1
+        lda     tmp3
+        beq     eot
+        cmp     tmp2
+        beq     load
+
+; The block of another module is read without storing it: its size, and
+; the checksum.
+
+skip:   jsr     readbyte
+        lda     ptr2
+        ora     ptr2+1
+        beq     block
+        jsr     count
+        jmp     skip
+
+load:   lda     ptr2
+        sta     _tape_size
+        lda     ptr2+1
+        sta     _tape_size+1
+        ldy     #0
+        sty     tmp3
+data:   lda     ptr2
+        ora     ptr2+1
+        beq     check
+        jsr     readbyte
+        sta     (ptr1),y
+        eor     tmp3
+        sta     tmp3
+        inc     ptr1
+        bne     next
+        inc     ptr1+1
+next:   jsr     count
+        jmp     data
+
+check:  jsr     readbyte
+        cmp     tmp3
+        bne     stop
+        lda     #TAPE_OK
+        beq     done
+
+eot:    lda     #TAPE_END
+        bne     done
+
+stop:   lda     #TAPE_ERROR
+
+; The motor is stopped, and the KERNAL is told to leave it so.
+
+done:   pha
+        lda     CPU_PORT
+        ora     #MOTOR_OFF
+        sta     CPU_PORT
+        lda     #1
+        sta     INTERLOCK
+        lda     VIC_CTRL
+        ora     #SCREEN_ON
+        sta     VIC_CTRL
+        lda     ICR1
+        cli
+        pla
+        ldx     #0
+        rts
+
+; Decrement the bytes left of the block.
+
+count:  lda     ptr2
+        bne     low
+        dec     ptr2+1
+low:    dec     ptr2
+        rts
+
+; Look for the beginning of a block: a pilot byte (bit by bit), then the
+; pilot bytes that follow, and the sync byte. The carry is set if RUN/STOP
+; has been pressed meanwhile.
+
+sync:   lda     #$7F
+        sta     KEY_COLUMN
+        lda     KEY_ROW
+        bpl     break
+        jsr     readbit
+        rol     tmp1
+        lda     tmp1
+        cmp     #PILOT
+        bne     sync
+pilot:  jsr     readbyte
+        cmp     #PILOT
+        beq     pilot
+        cmp     #SYNC
+        bne     sync
+        clc
+        rts
+break:  sec
+        rts
+
+; Read a byte (the most significant bit first) into A.
+
+readbyte:
+        ldx     #8
+shift:  jsr     readbit
+        rol     tmp1
+        dex
+        bne     shift
+        lda     tmp1
+        rts
+
+; Wait for the next pulse, and put its bit into the carry: the timer has
+; run out if the pulse was a long one. The timer is started again at once.
+
+readbit:
+        lda     #FLAG
+wait:   bit     ICR1
+        beq     wait
+        lda     ICR2
+        lsr     a
+        lsr     a
+        lda     #ONE_SHOT
+        sta     CRB2
+        rts
+
+.endif
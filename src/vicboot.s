@@ -0,0 +1,154 @@
+; /****************************************************************************
+;  * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+;  *                                                                          *
+;  * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+;  *--------------------------------------------------------------------------*
+;  * VIC-20 BOOT LOADER                                                       *
+;  ****************************************************************************/
+
+; The overlayed executable for VIC-20 is linked at $1001, as on the unexpanded
+; machine. With an expansion of 8K or more, the KERNAL puts the screen memory
+; at $1000 and BASIC at $1201, right over it: so the program cannot be loaded
+; and run as usual. This is a small BASIC program ("boot" on the disk image,
+; see the makefile) that can be loaded and run on any machine: it moves the
+; screen memory back to $1E00, loads the program at its address and starts
+; it, with BASIC pointing to it, as on the unexpanded machine.
+;
+; BASIC loads this program wherever its memory starts ($0401, $1001 or
+; $1201), so its line computes the address of the code that follows from
+; the pointer to the start of BASIC. That code is relocatable: it copies the
+; loader into the cassette buffer (where the program cannot overwrite it)
+; and jumps there. When the program ends, BASIC is ready, and the program
+; can be run again with RUN.
+
+;------------------------------------------------------------------------------
+
+        .import     __LOADER_LOAD__, __LOADER_RUN__, __LOADER_SIZE__
+
+; Pointers of BASIC to the start of the program and to its variables, and
+; the vector of its error handler.
+TXTTAB      = $2B
+VARTAB      = $2D
+IERROR      = $0300
+
+; BASIC routines that link the lines of the program and print "READY.".
+LNKPRG      = $C533
+READY       = $C474
+
+; Device used last (the one the boot loader has been loaded from).
+FA          = $BA
+
+; Page of the screen memory used by the KERNAL, and the VIC registers with
+; the position of the screen memory (and of the color memory).
+HIBASE      = $0288
+VIC_CR2     = $9002
+VIC_CR5     = $9005
+
+; Screen memory of the unexpanded machine, and the character that clears
+; the screen (and that makes the KERNAL move to the new screen memory).
+SCREEN      = $1E
+CLEAR       = $93
+
+; KERNAL routines.
+SETLFS      = $FFBA
+SETNAM      = $FFBD
+LOAD        = $FFD5
+CHROUT      = $FFD2
+
+; Address where the program is linked, and where it starts (after its line
+; of BASIC).
+PROGRAM     = $1001
+START       = $100D
+
+; Zero page used to copy the loader (free for the user programs).
+source      = $FB
+
+; Offset of the code from the start of BASIC: the size of the line.
+CODE_OFFSET = 26
+
+;------------------------------------------------------------------------------
+
+.segment "LOADADDR"
+
+        .word   PROGRAM
+
+;------------------------------------------------------------------------------
+
+.segment "CODE"
+
+; 10 SYS PEEK(43)+256*PEEK(44)+26 (tokens: SYS, PEEK, "+" and "*"). The link
+; to the next line is written again by BASIC when it loads the program.
+
+basic:  .word   last
+        .word   10
+        .byte   $9E, $C2, "(43)", $AA, "256", $AC, $C2, "(44)", $AA, "26", 0
+last:   .word   0
+
+        .assert * - basic = CODE_OFFSET, error, "the line does not match CODE_OFFSET"
+
+; The loader follows this code into the file.
+
+        clc
+        lda     TXTTAB
+        adc     #<(__LOADER_LOAD__ - basic)
+        sta     source
+        lda     TXTTAB+1
+        adc     #>(__LOADER_LOAD__ - basic)
+        sta     source+1
+        ldy     #0
+copy:   lda     (source),y
+        sta     __LOADER_RUN__,y
+        iny
+        cpy     #<__LOADER_SIZE__
+        bne     copy
+        jmp     __LOADER_RUN__
+
+;------------------------------------------------------------------------------
+
+.segment "LOADER"
+
+loader: lda     VIC_CR5
+        and     #$0F
+        ora     #$F0
+        sta     VIC_CR5
+        lda     VIC_CR2
+        ora     #$80
+        sta     VIC_CR2
+        lda     #SCREEN
+        sta     HIBASE
+        lda     #CLEAR
+        jsr     CHROUT
+
+        lda     #name_end - name
+        ldx     #<name
+        ldy     #>name
+        jsr     SETNAM
+        lda     #1
+        ldx     FA
+        ldy     #1
+        jsr     SETLFS
+        lda     #0
+        jsr     LOAD
+        bcs     failed
+
+; BASIC points to the program, whose variables follow it.
+
+        stx     VARTAB
+        sty     VARTAB+1
+        lda     #<PROGRAM
+        sta     TXTTAB
+        lda     #>PROGRAM
+        sta     TXTTAB+1
+        jsr     LNKPRG
+        jsr     START
+        jmp     READY
+
+; The error of the KERNAL is printed by BASIC.
+
+failed: tax
+        jmp     (IERROR)
+
+; Name of the program on the disk image (see PROGRAMNAME into the makefile).
+
+name:   .byte   "demo"
+name_end:
@@ -0,0 +1,555 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * HOST TOOL: BENCHMARK RESULTS                                             *
+ ****************************************************************************/
+
+// This program is executed on the host (not on the retrocomputer) by the
+// "bench" target of the makefile, after the benchmark build of the program
+// has been run into the emulator. It has two commands:
+//
+//   ovlbench extract <disk image> <file> <results>
+//
+// reads the counters written by the overlay manager into the sequential
+// file "file" of the disk image (see overlay_save() into overlay.c), and it
+// writes them into "results", one "<name> <value>" line for each counter
+// (for instance "demo.1.cycles 123456"), adding the cycles of a single load
+// of each module. If the deepest use of the stack has been measured (see
+// STACKCHECK into the makefile), it also suggests the size of the stack;
+//
+//   ovlbench compare <baseline> <results> [<tolerance>]
+//
+// compares the results with the ones stored as a baseline, and it prints
+// the difference of each counter. It fails if any counter is worse than
+// the baseline by more than "tolerance" percent (default: 2). If there is
+// no baseline yet, it only prints the results.
+
+/****************************************************************************
+ ** INCLUDE SECTION
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/****************************************************************************
+ ** DEFINITIONS SECTION
+ ****************************************************************************/
+
+// Size of a 1541 disk image (35 tracks), with or without the error bytes,
+// and of the 40 tracks variant.
+#define D64_SIZE            174848
+#define D64_SIZE_ERRORS     175531
+#define D64_SIZE_40         196608
+#define D64_SIZE_40_ERRORS  197376
+
+// Size of a block.
+#define BLOCK               256
+
+// Position of the directory.
+#define DIRECTORY_TRACK     18
+#define DIRECTORY_SECTOR    1
+
+// Size of a directory entry, length of a file name and type of a
+// sequential file.
+#define ENTRY_SIZE          32
+#define NAME_SIZE           16
+#define TYPE_SEQ            1
+
+// Maximum number of blocks of the file, and of counters.
+#define MAX_BLOCKS          64
+#define MAX_COUNTERS        64
+
+// Maximum length of a line, and of the name of a counter.
+#define MAX_LINE            128
+#define MAX_NAME            48
+
+// Default tolerance, in percent.
+#define TOLERANCE           2.0
+
+// Bytes added to the deepest use of the stack before suggesting its size,
+// since only the paths taken by the benchmark have been measured; the size
+// is rounded up to a multiple of STACK_ROUND.
+#define STACK_MARGIN        64
+#define STACK_ROUND         16
+
+// A single counter.
+typedef struct counter {
+    char name[MAX_NAME];
+    unsigned long value;
+} counter;
+
+/****************************************************************************
+ ** VARIABLES SECTION
+ ****************************************************************************/
+
+static unsigned char image[D64_SIZE_40_ERRORS];
+static long image_size;
+static int tracks;
+
+// Text of the file, converted into ASCII.
+static char text[MAX_BLOCKS * BLOCK];
+static long text_size = 0;
+
+static counter counters[MAX_COUNTERS];
+static int counter_count = 0;
+
+/****************************************************************************
+ ** DISK IMAGE FUNCTIONS
+ ****************************************************************************/
+
+/**
+ * This function returns the number of sectors of the track "track".
+ */
+static int sectors(int track)
+{
+    if (track <= 17) {
+        return 21;
+    } else if (track <= 24) {
+        return 19;
+    } else if (track <= 30) {
+        return 18;
+    }
+    return 17;
+}
+
+/**
+ * This function returns the offset of the block at "track" and "sector"
+ * into the image, or -1 if it does not exist.
+ */
+static long offset(int track, int sector)
+{
+    long result = 0;
+    int i;
+
+    if (track < 1 || track > tracks || sector < 0 || sector >= sectors(track)) {
+        return -1;
+    }
+    for (i = 1; i < track; ++i) {
+        result += sectors(i);
+    }
+    return (result + sector) * BLOCK;
+}
+
+/**
+ * This function converts the (ASCII) file name "name" into the padded
+ * PETSCII one, as it is written into the directory by the DOS.
+ */
+static void petscii(const char* name, unsigned char* result)
+{
+    int i;
+
+    for (i = 0; i < NAME_SIZE; ++i) {
+        unsigned char c = 0xa0;
+        if (*name) {
+            c = (unsigned char)*name++;
+            if (c >= 'a' && c <= 'z') {
+                c = (unsigned char)(c - 'a' + 0x41);
+            } else if (c >= 'A' && c <= 'Z') {
+                c = (unsigned char)(c - 'A' + 0xc1);
+            }
+        }
+        result[i] = c;
+    }
+}
+
+/**
+ * This function converts the PETSCII character "c" into ASCII: letters
+ * become lowercase (as they are written by the program), carriage returns
+ * become new lines and the other characters become spaces.
+ */
+static char ascii(unsigned char c)
+{
+    if (c >= 0x41 && c <= 0x5a) {
+        return (char)(c - 0x41 + 'a');
+    } else if (c >= 0xc1 && c <= 0xda) {
+        return (char)(c - 0xc1 + 'A');
+    } else if (c == 0x0d) {
+        return '\n';
+    } else if (c >= 0x20 && c < 0x41) {
+        return (char)c;
+    }
+    return ' ';
+}
+
+/**
+ * This function reads the sequential file named "name" from the image into
+ * the text buffer, converted into ASCII. It returns 0 if not found.
+ */
+static int read_file(const char* name)
+{
+    unsigned char wanted[NAME_SIZE];
+    int track = DIRECTORY_TRACK;
+    int sector = DIRECTORY_SECTOR;
+    int visited = 0;
+    int blocks = 0;
+    long block = -1;
+    int i;
+
+    petscii(name, wanted);
+
+    // Look for the file into the directory.
+    while (track != 0 && visited++ < sectors(DIRECTORY_TRACK)) {
+        long directory = offset(track, sector);
+        if (directory < 0) {
+            return 0;
+        }
+        for (i = 0; i < BLOCK; i += ENTRY_SIZE) {
+            const unsigned char* entry = image + directory + i;
+            if ((entry[2] & 0x07) == TYPE_SEQ && memcmp(entry + 5, wanted, NAME_SIZE) == 0) {
+                block = offset(entry[3], entry[4]);
+                break;
+            }
+        }
+        if (block >= 0) {
+            break;
+        }
+        track = image[directory];
+        sector = image[directory + 1];
+    }
+
+    // Read the chain of blocks.
+    while (block >= 0) {
+        int last;
+        if (++blocks > MAX_BLOCKS) {
+            return 0;
+        }
+        last = image[block] ? BLOCK - 1 : image[block + 1];
+        for (i = 2; i <= last; ++i) {
+            text[text_size++] = ascii(image[block + i]);
+        }
+        block = image[block] ? offset(image[block], image[block + 1]) : -1;
+    }
+    return blocks > 0;
+}
+
+/****************************************************************************
+ ** COUNTERS FUNCTIONS
+ ****************************************************************************/
+
+/**
+ * This function adds the counter "name" with the value "value". Names too
+ * long are rejected, since once truncated they could match other counters.
+ */
+static void add_counter(const char* name, unsigned long value)
+{
+    if (strlen(name) >= MAX_NAME) {
+        fprintf(stderr, "ovlbench: counter name longer than %d characters ignored: %s\n", MAX_NAME - 1, name);
+        return;
+    }
+    if (counter_count < MAX_COUNTERS) {
+        strcpy(counters[counter_count].name, name);
+        counters[counter_count].value = value;
+        ++counter_count;
+    }
+}
+
+/**
+ * This function returns the counter "name" of the set "set" (of "count"
+ * counters), or NULL if not present.
+ */
+static const counter* find_counter(const counter* set, int count, const char* name)
+{
+    int i;
+
+    for (i = 0; i < count; ++i) {
+        if (strcmp(set[i].name, name) == 0) {
+            return &set[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * This function returns the name of the counter written by the overlay
+ * manager as "word" (a letter before a number, or a word).
+ */
+static const char* counter_name(const char* word)
+{
+    if (strcmp(word, "L") == 0) {
+        return "loads";
+    } else if (strcmp(word, "B") == 0) {
+        return "bytes";
+    } else if (strcmp(word, "J") == 0) {
+        return "jiffies";
+    } else if (strcmp(word, "C") == 0) {
+        return "cycles";
+    } else if (strcmp(word, "HIT") == 0) {
+        return "hits";
+    } else if (strcmp(word, "MISS") == 0) {
+        return "misses";
+    } else if (strcmp(word, "PREFETCH") == 0) {
+        return "prefetches";
+    } else if (strcmp(word, "S") == 0) {
+        return "stack";
+    } else if (strcmp(word, "U") == 0) {
+        return "used";
+    } else if (strcmp(word, "R") == 0) {
+        return "reserved";
+    }
+    return word;
+}
+
+/**
+ * This function tells if the string "word" is a number.
+ */
+static int is_number(const char* word)
+{
+    if (!*word) {
+        return 0;
+    }
+    while (isdigit((unsigned char)*word)) {
+        ++word;
+    }
+    return *word == 0;
+}
+
+/**
+ * This function parses a line written by the overlay manager. A line starts
+ * with a subject, followed by letters before numbers ("demo.1 L3 B2345 J120
+ * C1970000", "WAIT J480"), or it is made by words and numbers ("HIT 12 MISS
+ * 5"). The subject is written in lowercase into the name of the counters.
+ */
+static void parse_line(char* line)
+{
+    char* words[MAX_LINE / 2];
+    char name[MAX_NAME * 2];
+    char* subject = "";
+    unsigned long loads = 0;
+    unsigned long cycles = 0;
+    int count = 0;
+    int i = 0;
+
+    for (words[count] = strtok(line, " "); words[count] != NULL; words[count] = strtok(NULL, " ")) {
+        ++count;
+    }
+    if (count > 1 && !is_number(words[1])) {
+        char* c;
+        subject = words[0];
+        for (c = subject; *c; ++c) {
+            *c = (char)tolower((unsigned char)*c);
+        }
+        i = 1;
+    }
+
+    while (i < count) {
+        if (i + 1 < count && is_number(words[i + 1])) {
+            add_counter(counter_name(words[i]), strtoul(words[i + 1], NULL, 10));
+            i += 2;
+        } else {
+            char* digits = words[i];
+            unsigned long value;
+            while (*digits && !isdigit((unsigned char)*digits)) {
+                ++digits;
+            }
+            value = strtoul(digits, NULL, 10);
+            *digits = 0;
+            snprintf(name, sizeof(name), "%s%s%s", subject, *subject ? "." : "", counter_name(words[i]));
+            add_counter(name, value);
+            if (strcmp(words[i], "L") == 0) {
+                loads = value;
+            } else if (strcmp(words[i], "C") == 0) {
+                cycles = value;
+            }
+            ++i;
+        }
+    }
+
+    if (loads > 0 && cycles > 0) {
+        snprintf(name, sizeof(name), "%s.cycles_per_load", subject);
+        add_counter(name, cycles / loads);
+    }
+}
+
+/**
+ * This function tells if a greater value of the counter "name" is better.
+ */
+static int greater_is_better(const char* name)
+{
+    return strcmp(name, "hits") == 0 || strcmp(name, "prefetches") == 0;
+}
+
+/**
+ * This function prints the size of the stack that would be enough, if its
+ * deepest use has been measured.
+ */
+static void suggest_stack(void)
+{
+    const counter* used = find_counter(counters, counter_count, "stack.used");
+    const counter* reserved = find_counter(counters, counter_count, "stack.reserved");
+    unsigned long size;
+
+    if (used == NULL || reserved == NULL) {
+        return;
+    }
+    size = (used->value + STACK_MARGIN + STACK_ROUND - 1) / STACK_ROUND * STACK_ROUND;
+    if (used->value > reserved->value) {
+        printf("ovlbench: the stack used %lu bytes, more than its %lu: it overflowed below its area\n",
+                    used->value, reserved->value);
+    } else {
+        printf("ovlbench: the stack used %lu bytes of %lu\n", used->value, reserved->value);
+    }
+    printf("ovlbench: suggested size of the stack %lu bytes (C64STACKSIZE / VIC20STACKSIZE into the makefile)\n", size);
+}
+
+/**
+ * This function reads the counters written by ovlbench extract from the
+ * file "name" into "set". It returns the number of counters, or -1 if the
+ * file does not exist.
+ */
+static int read_counters(const char* name, counter* set)
+{
+    char line[MAX_LINE];
+    int count = 0;
+    FILE* f = fopen(name, "r");
+
+    if (f == NULL) {
+        return -1;
+    }
+    while (count < MAX_COUNTERS && fgets(line, sizeof(line), f) != NULL) {
+        char* value = strchr(line, ' ');
+        if (value == NULL) {
+            continue;
+        }
+        *value++ = 0;
+        if (strlen(line) >= MAX_NAME) {
+            continue;
+        }
+        strcpy(set[count].name, line);
+        set[count].value = strtoul(value, NULL, 10);
+        ++count;
+    }
+    fclose(f);
+    return count;
+}
+
+/****************************************************************************
+ ** COMMANDS SECTION
+ ****************************************************************************/
+
+/**
+ * This function implements the "extract" command.
+ */
+static int extract(const char* image_name, const char* file_name, const char* results_name)
+{
+    FILE* f;
+    char* line;
+    int i;
+
+    f = fopen(image_name, "rb");
+    if (f == NULL) {
+        perror(image_name);
+        return EXIT_FAILURE;
+    }
+    image_size = (long)fread(image, 1, sizeof(image), f);
+    fclose(f);
+
+    if (image_size == D64_SIZE || image_size == D64_SIZE_ERRORS) {
+        tracks = 35;
+    } else if (image_size == D64_SIZE_40 || image_size == D64_SIZE_40_ERRORS) {
+        tracks = 40;
+    } else {
+        fprintf(stderr, "%s: not a D64 disk image\n", image_name);
+        return EXIT_FAILURE;
+    }
+
+    if (!read_file(file_name)) {
+        fprintf(stderr, "%s: file \"%s\" not found (did the benchmark end?)\n", image_name, file_name);
+        return EXIT_FAILURE;
+    }
+
+    text[text_size] = 0;
+    for (line = text; *line; ) {
+        char* end = strchr(line, '\n');
+        if (end != NULL) {
+            *end = 0;
+        }
+        parse_line(line);
+        if (end == NULL) {
+            break;
+        }
+        line = end + 1;
+    }
+
+    f = fopen(results_name, "w");
+    if (f == NULL) {
+        perror(results_name);
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < counter_count; ++i) {
+        fprintf(f, "%s %lu\n", counters[i].name, counters[i].value);
+    }
+    if (fclose(f) != 0) {
+        perror(results_name);
+        return EXIT_FAILURE;
+    }
+    suggest_stack();
+    return EXIT_SUCCESS;
+}
+
+/**
+ * This function implements the "compare" command.
+ */
+static int compare(const char* baseline_name, const char* results_name, double tolerance)
+{
+    static counter baseline[MAX_COUNTERS];
+    int baseline_count;
+    int worse = 0;
+    int i;
+
+    counter_count = read_counters(results_name, counters);
+    if (counter_count < 0) {
+        perror(results_name);
+        return EXIT_FAILURE;
+    }
+    baseline_count = read_counters(baseline_name, baseline);
+    if (baseline_count < 0) {
+        printf("ovlbench: no baseline (%s), results only\n", baseline_name);
+    }
+
+    printf("%-28s %12s %12s %8s\n", "counter", "baseline", "current", "delta");
+    for (i = 0; i < counter_count; ++i) {
+        const counter* old = baseline_count > 0 ? find_counter(baseline, baseline_count, counters[i].name) : NULL;
+        double delta;
+        const char* mark = "";
+
+        if (old == NULL) {
+            printf("%-28s %12s %12lu\n", counters[i].name, "-", counters[i].value);
+            continue;
+        }
+        if (old->value == 0) {
+            delta = counters[i].value ? 100.0 : 0.0;
+        } else {
+            delta = ((double)counters[i].value - (double)old->value) * 100.0 / (double)old->value;
+        }
+        if (greater_is_better(counters[i].name) ? (delta < -tolerance) : (delta > tolerance)) {
+            mark = " WORSE";
+            ++worse;
+        } else if (greater_is_better(counters[i].name) ? (delta > tolerance) : (delta < -tolerance)) {
+            mark = " better";
+        }
+        printf("%-28s %12lu %12lu %+7.1f%%%s\n", counters[i].name, old->value, counters[i].value, delta, mark);
+    }
+
+    if (worse) {
+        fprintf(stderr, "ovlbench: %d counters worse than the baseline (tolerance %.1f%%)\n", worse, tolerance);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 5 && strcmp(argv[1], "extract") == 0) {
+        return extract(argv[2], argv[3], argv[4]);
+    }
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "compare") == 0) {
+        return compare(argv[2], argv[3], argc == 5 ? atof(argv[4]) : TOLERANCE);
+    }
+    fprintf(stderr, "usage: %s extract <disk image> <file> <results>\n", argv[0]);
+    fprintf(stderr, "       %s compare <baseline> <results> [<tolerance>]\n", argv[0]);
+    return EXIT_FAILURE;
+}
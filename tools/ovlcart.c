@@ -0,0 +1,291 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * HOST TOOL: CARTRIDGE IMAGE                                               *
+ ****************************************************************************/
+
+// This program is executed on the host (not on the retrocomputer) during
+// the build of the "c64crt" target. It writes a Magic Desk cartridge image
+// (CRT format, as used by VICE: x64sc -cartcrt <image>), made by 8K banks
+// that are shown at $8000 by writing their number into $DE00:
+//
+//   - the boot code (see cartboot.s) at the beginning of the first bank;
+//   - a header: bank and page where the resident program starts, its load
+//     address (2 bytes), its size (2 bytes), the address where it starts
+//     (2 bytes, taken from the BASIC line "SYS ...");
+//   - the resident program, and then each module, without the load address;
+//     each of them starts at the beginning of a page, and it goes on into
+//     the next bank when the end of a bank is reached.
+//
+// The position of each module is written into the table of the resident
+// program (see overlay_cartridge into main.h) before writing it into the
+// cartridge: the table is found by looking for its signature, and it is
+// followed by the number of modules expected, and then by 6 bytes for each
+// module (bank, page, load address, size).
+//
+// Usage: ovlcart <boot code> <program> <cartridge image> <module> [<module> ...]
+
+/****************************************************************************
+ ** INCLUDE SECTION
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/****************************************************************************
+ ** DEFINITIONS SECTION
+ ****************************************************************************/
+
+// Size of a bank, and address where it is shown.
+#define BANK_SIZE           8192
+#define BANK_ADDRESS        0x8000
+
+// Maximum number of banks of a Magic Desk cartridge, and minimum number of
+// banks of the image (the cartridges are made by 32K, 64K or 128K).
+#define MAX_BANKS           16
+#define MIN_BANKS           4
+
+// Size of a page.
+#define PAGE                256
+
+// Maximum size of a file (the whole address space).
+#define MAX_FILE            65536
+
+// Size of the load address, at the beginning of a file, and of the header
+// of the resident program.
+#define LOAD_SIZE           2
+#define HEADER_SIZE         8
+
+// Size of an entry of the table of the resident program.
+#define ENTRY_SIZE          6
+
+// CRT format: size of the header, hardware type of the Magic Desk and size
+// of the header of each bank ("CHIP" packet).
+#define CRT_HEADER          64
+#define CRT_MAGIC_DESK      19
+#define CRT_CHIP_HEADER     16
+
+// BASIC token of SYS.
+#define TOKEN_SYS           0x9e
+
+// Signature of the table into the resident program.
+static const unsigned char signature[] = { 0x4f, 0x56, 0x4c, 0x42, 0x41, 0x4e, 0x4b, 0x53 };
+
+/****************************************************************************
+ ** VARIABLES SECTION
+ ****************************************************************************/
+
+static unsigned char rom[MAX_BANKS * BANK_SIZE];
+static unsigned char program[MAX_FILE + LOAD_SIZE];
+static unsigned char module[MAX_FILE + LOAD_SIZE];
+
+/****************************************************************************
+ ** FUNCTIONS SECTION
+ ****************************************************************************/
+
+/**
+ * This function reads the file "path" into "buffer". It returns its size,
+ * or -1 if any error occours.
+ */
+static long read_file(const char* path, unsigned char* buffer, long size)
+{
+    FILE* f = fopen(path, "rb");
+    long result;
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    result = (long)fread(buffer, 1, (size_t)size, f);
+    fclose(f);
+    return result;
+}
+
+/**
+ * This function writes the 16 bits "value" into "p", in big endian order
+ * (as used by the CRT format).
+ */
+static void put_word(unsigned char* p, unsigned int value)
+{
+    p[0] = (unsigned char)(value >> 8);
+    p[1] = (unsigned char)value;
+}
+
+/**
+ * This function writes the 32 bits "value" into "p", in big endian order.
+ */
+static void put_long(unsigned char* p, unsigned long value)
+{
+    put_word(p, (unsigned int)(value >> 16));
+    put_word(p + 2, (unsigned int)(value & 0xffff));
+}
+
+/**
+ * This function returns the address where the program "program", of "size"
+ * bytes, starts: the one written after SYS into its BASIC line. It returns
+ * -1 if not found.
+ */
+static long start_address(const unsigned char* program, long size)
+{
+    long i;
+
+    for (i = LOAD_SIZE; i < size && i < LOAD_SIZE + 32; ++i) {
+        if (program[i] == TOKEN_SYS) {
+            long address = 0;
+            ++i;
+            while (i < size && program[i] == ' ') {
+                ++i;
+            }
+            if (i >= size || program[i] < '0' || program[i] > '9') {
+                return -1;
+            }
+            while (i < size && program[i] >= '0' && program[i] <= '9') {
+                address = address * 10 + (program[i++] - '0');
+            }
+            return address;
+        }
+    }
+    return -1;
+}
+
+/**
+ * This function writes the description of "size" bytes that start at
+ * "position" into the cartridge, and go to "address", into "entry".
+ */
+static void describe(unsigned char* entry, long position, long address, long size)
+{
+    entry[0] = (unsigned char)(position / BANK_SIZE);
+    entry[1] = (unsigned char)((BANK_ADDRESS + position % BANK_SIZE) >> 8);
+    entry[2] = (unsigned char)(address & 0xff);
+    entry[3] = (unsigned char)(address >> 8);
+    entry[4] = (unsigned char)(size & 0xff);
+    entry[5] = (unsigned char)(size >> 8);
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned char header[CRT_HEADER];
+    unsigned char chip[CRT_CHIP_HEADER];
+    long boot_size;
+    long program_size;
+    long position;
+    long start;
+    long table;
+    long banks;
+    int modules;
+    int i;
+    FILE* f;
+
+    if (argc < 5) {
+        fprintf(stderr, "usage: %s <boot code> <program> <cartridge image> <module> [<module> ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    boot_size = read_file(argv[1], rom, BANK_SIZE);
+    program_size = read_file(argv[2], program, sizeof(program));
+    if (boot_size < 0 || program_size < 0) {
+        return EXIT_FAILURE;
+    }
+    if (boot_size + HEADER_SIZE > BANK_SIZE) {
+        fprintf(stderr, "%s: the boot code does not fit into the first bank\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    start = start_address(program, program_size);
+    if (program_size <= LOAD_SIZE || start < 0) {
+        fprintf(stderr, "%s: not a program started by SYS\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    // Find the table into the resident program.
+    for (table = LOAD_SIZE; table + (long)sizeof(signature) < program_size; ++table) {
+        if (memcmp(program + table, signature, sizeof(signature)) == 0) {
+            break;
+        }
+    }
+    modules = argc - 4;
+    table += sizeof(signature);
+    if (table >= program_size || table + 1 + modules * ENTRY_SIZE > program_size) {
+        fprintf(stderr, "%s: table not found\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    if (program[table] != modules) {
+        fprintf(stderr, "%s: it expects %d modules, not %d\n", argv[2], program[table], modules);
+        return EXIT_FAILURE;
+    }
+
+    // Place the program after the header, and each module after it. The
+    // table is filled before the program is copied.
+    position = (boot_size + HEADER_SIZE + PAGE - 1) / PAGE * PAGE;
+    if (position + program_size - LOAD_SIZE > (long)sizeof(rom)) {
+        fprintf(stderr, "%s: the cartridge is full (%d banks)\n", argv[2], MAX_BANKS);
+        return EXIT_FAILURE;
+    }
+    describe(rom + boot_size, position, program[0] | (program[1] << 8), program_size - LOAD_SIZE);
+    rom[boot_size + 6] = (unsigned char)(start & 0xff);
+    rom[boot_size + 7] = (unsigned char)(start >> 8);
+    position += (program_size - LOAD_SIZE + PAGE - 1) / PAGE * PAGE;
+
+    for (i = 0; i < modules; ++i) {
+        long size = read_file(argv[4 + i], module, sizeof(module));
+        if (size < 0) {
+            return EXIT_FAILURE;
+        }
+        if (size <= LOAD_SIZE) {
+            fprintf(stderr, "%s: empty module\n", argv[4 + i]);
+            return EXIT_FAILURE;
+        }
+        size -= LOAD_SIZE;
+        if (position + size > (long)sizeof(rom)) {
+            fprintf(stderr, "%s: the cartridge is full (%d banks)\n", argv[4 + i], MAX_BANKS);
+            return EXIT_FAILURE;
+        }
+        describe(program + table + 1 + i * ENTRY_SIZE, position, module[0] | (module[1] << 8), size);
+        memcpy(rom + position, module + LOAD_SIZE, (size_t)size);
+        printf("ovlcart: %s: bank %ld, $%04lx, %ld bytes\n", argv[4 + i], position / BANK_SIZE,
+                    BANK_ADDRESS + position % BANK_SIZE, size);
+        position += (size + PAGE - 1) / PAGE * PAGE;
+    }
+
+    memcpy(rom + (boot_size + HEADER_SIZE + PAGE - 1) / PAGE * PAGE, program + LOAD_SIZE, (size_t)(program_size - LOAD_SIZE));
+
+    // Only the banks used are written, but at least MIN_BANKS, and always
+    // a power of two.
+    for (banks = MIN_BANKS; banks * BANK_SIZE < position; banks *= 2) {
+    }
+
+    f = fopen(argv[3], "wb");
+    if (f == NULL) {
+        perror(argv[3]);
+        return EXIT_FAILURE;
+    }
+    memset(header, 0, sizeof(header));
+    memcpy(header, "C64 CARTRIDGE   ", 16);
+    put_long(header + 0x10, CRT_HEADER);
+    put_word(header + 0x14, 0x0100);
+    put_word(header + 0x16, CRT_MAGIC_DESK);
+    header[0x18] = 0;       // EXROM active: 8K at $8000.
+    header[0x19] = 1;       // GAME inactive.
+    strncpy((char*)header + 0x20, "OVL6502", 32);
+    fwrite(header, 1, sizeof(header), f);
+    for (i = 0; i < banks; ++i) {
+        memset(chip, 0, sizeof(chip));
+        memcpy(chip, "CHIP", 4);
+        put_long(chip + 4, CRT_CHIP_HEADER + BANK_SIZE);
+        put_word(chip + 8, 0);
+        put_word(chip + 10, (unsigned int)i);
+        put_word(chip + 12, BANK_ADDRESS);
+        put_word(chip + 14, BANK_SIZE);
+        fwrite(chip, 1, sizeof(chip), f);
+        fwrite(rom + i * BANK_SIZE, 1, BANK_SIZE, f);
+    }
+    if (fclose(f) != 0) {
+        perror(argv[3]);
+        return EXIT_FAILURE;
+    }
+
+    printf("ovlcart: %s: %ld banks, program of %ld bytes starting at %ld\n", argv[3], banks, program_size - LOAD_SIZE, start);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,706 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * HOST TOOL: DISK LAYOUT OF THE OVERLAY MODULES                            *
+ ****************************************************************************/
+
+// This program is executed on the host (not on the retrocomputer) during
+// the build, to write the overlay modules on the disk image. It reads the
+// sequence of loads expected during a session (declared, as src/main.seq,
+// or profiled by the native build with its -l option): a list of names of
+// files, separated by blanks, where "#" starts a comment. It has two
+// commands:
+//
+//   ovllayout write [-d] <loader> <sequence> <disk image> <cc1541> <name>=<file> [...]
+//
+// places the files on the tracks just above the directory (the one loaded
+// most often first, then the one loaded most often after it, and so on),
+// with the sector interleave that suits the loader, and it writes them by
+// running cc1541 once. Then it estimates the cost of the layout, as:
+//
+//   ovllayout cost [-d] <loader> <sequence> <disk image>
+//
+// that tells how long the drive would take to move the head (seek), to
+// wait for the sectors (rotation) and to send them (transfer), for each
+// file and for the whole sequence. The loader is "kernal" (cbm_load() and
+// the KERNAL routines) or "fast" (the fast-loader); with -d, the modules
+// are read by position (see DIRECT into the makefile), otherwise each load
+// looks for the file into the directory first.
+//
+// The model of the 1541 is a rough one: a step of the head takes STEP_MS
+// (plus SETTLE_MS once it stops), a revolution takes REVOLUTION_MS (so a
+// sector takes REVOLUTION_MS divided by the sectors of its track) and the
+// first sector after a seek is waited for half a revolution. The loader
+// takes the time of its BLOCK_MS to send a block: the next one can be read
+// only after that, so the interleave should skip the sectors that pass
+// meanwhile, and not more.
+
+/****************************************************************************
+ ** INCLUDE SECTION
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/****************************************************************************
+ ** DEFINITIONS SECTION
+ ****************************************************************************/
+
+// Size of a 1541 disk image (35 tracks), with or without the error bytes,
+// and of the 40 tracks variant.
+#define D64_SIZE            174848
+#define D64_SIZE_ERRORS     175531
+#define D64_SIZE_40         196608
+#define D64_SIZE_40_ERRORS  197376
+
+// Size of a block, and of the data part of a block.
+#define BLOCK               256
+#define BLOCK_DATA          254
+
+// Position of the directory, and of the BAM.
+#define DIRECTORY_TRACK     18
+#define DIRECTORY_SECTOR    1
+#define BAM_SECTOR          0
+
+// Size of a directory entry, and length of a file name.
+#define ENTRY_SIZE          32
+#define NAME_SIZE           16
+
+// Maximum number of tracks, of sectors of a track, of files, of blocks of
+// a file and of loads into the sequence.
+#define MAX_TRACKS          40
+#define MAX_SECTORS         21
+#define MAX_FILES           32
+#define MAX_BLOCKS          683
+#define MAX_LOADS           1024
+
+// Maximum length of a name, and of the command that runs cc1541.
+#define MAX_NAME            64
+#define MAX_COMMAND         8192
+
+// Model of the 1541 (see above), in milliseconds.
+#define STEP_MS             6.0
+#define SETTLE_MS           20.0
+#define REVOLUTION_MS       200.0
+
+// Time taken by each loader to send a block to the computer (about 390
+// bytes/s for the KERNAL routines, and 6 KB/s for the fast-loader), in
+// milliseconds.
+#define KERNAL_BLOCK_MS     650.0
+#define FAST_BLOCK_MS       40.0
+
+// A file of the layout: its name on the disk, the local file, its size in
+// blocks and how it is placed (first track and sector, and interleave).
+typedef struct layout_file {
+    char name[MAX_NAME];
+    const char* path;
+    int blocks;
+    int loads;
+    int track;
+    int sector;
+    int interleave;
+} layout_file;
+
+/****************************************************************************
+ ** VARIABLES SECTION
+ ****************************************************************************/
+
+static unsigned char image[D64_SIZE_40_ERRORS];
+static long image_size;
+static int tracks;
+
+// Sectors used, as far as the layout knows.
+static unsigned char used[MAX_TRACKS + 1][MAX_SECTORS];
+
+// Sequence of loads.
+static char loads[MAX_LOADS][MAX_NAME];
+static int load_count = 0;
+
+// Files to write.
+static layout_file files[MAX_FILES];
+static int file_count = 0;
+
+// Loader in use.
+static double block_ms = KERNAL_BLOCK_MS;
+static int direct = 0;
+
+/****************************************************************************
+ ** DISK IMAGE FUNCTIONS
+ ****************************************************************************/
+
+/**
+ * This function returns the number of sectors of the track "track".
+ */
+static int sectors(int track)
+{
+    if (track <= 17) {
+        return 21;
+    } else if (track <= 24) {
+        return 19;
+    } else if (track <= 30) {
+        return 18;
+    }
+    return 17;
+}
+
+/**
+ * This function returns the offset of the block at "track" and "sector"
+ * into the image, or -1 if it does not exist.
+ */
+static long offset(int track, int sector)
+{
+    long result = 0;
+    int i;
+
+    if (track < 1 || track > tracks || sector < 0 || sector >= sectors(track)) {
+        return -1;
+    }
+    for (i = 1; i < track; ++i) {
+        result += sectors(i);
+    }
+    return (result + sector) * BLOCK;
+}
+
+/**
+ * This function converts the (ASCII) file name "name" into the padded
+ * PETSCII one, as it is written into the directory by cc1541.
+ */
+static void petscii(const char* name, unsigned char* result)
+{
+    int i;
+
+    for (i = 0; i < NAME_SIZE; ++i) {
+        unsigned char c = 0xa0;
+        if (*name) {
+            c = (unsigned char)*name++;
+            if (c >= 'a' && c <= 'z') {
+                c = (unsigned char)(c - 'a' + 0x41);
+            } else if (c >= 'A' && c <= 'Z') {
+                c = (unsigned char)(c - 'A' + 0xc1);
+            }
+        }
+        result[i] = c;
+    }
+}
+
+/**
+ * This function reads the disk image "name". It returns 0 if it cannot be
+ * read, or if it is not a disk image.
+ */
+static int read_image(const char* name)
+{
+    FILE* f = fopen(name, "rb");
+
+    if (f == NULL) {
+        return 0;
+    }
+    image_size = (long)fread(image, 1, sizeof(image), f);
+    fclose(f);
+
+    if (image_size == D64_SIZE || image_size == D64_SIZE_ERRORS) {
+        tracks = 35;
+    } else if (image_size == D64_SIZE_40 || image_size == D64_SIZE_40_ERRORS) {
+        tracks = 40;
+    } else {
+        fprintf(stderr, "%s: not a D64 disk image\n", name);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * This function looks for the file named "name" into the directory. It
+ * returns the offset of its entry into the image, or -1 if not found. The
+ * number of the directory block where it has been found (from 0) is put
+ * into "index", if not NULL.
+ */
+static long find(const char* name, int* index)
+{
+    unsigned char wanted[NAME_SIZE];
+    int track = DIRECTORY_TRACK;
+    int sector = DIRECTORY_SECTOR;
+    int visited = 0;
+
+    petscii(name, wanted);
+
+    while (track != 0 && visited < sectors(DIRECTORY_TRACK)) {
+        long block = offset(track, sector);
+        int i;
+        if (block < 0) {
+            return -1;
+        }
+        for (i = 0; i < BLOCK; i += ENTRY_SIZE) {
+            const unsigned char* entry = image + block + i;
+            if (entry[2] != 0 && memcmp(entry + 5, wanted, NAME_SIZE) == 0) {
+                if (index != NULL) {
+                    *index = visited;
+                }
+                return block + i;
+            }
+        }
+        ++visited;
+        track = image[block];
+        sector = image[block + 1];
+    }
+    return -1;
+}
+
+/**
+ * This function reads the chain of blocks of the file whose entry is at
+ * "entry" into "chain" (track and sector of each block). It returns the
+ * number of blocks, or -1 if the chain is broken.
+ */
+static int read_chain(long entry, unsigned char chain[][2])
+{
+    int track = image[entry + 3];
+    int sector = image[entry + 4];
+    int blocks = 0;
+
+    while (track != 0) {
+        long block = offset(track, sector);
+        if (block < 0 || blocks >= MAX_BLOCKS) {
+            return -1;
+        }
+        chain[blocks][0] = (unsigned char)track;
+        chain[blocks][1] = (unsigned char)sector;
+        ++blocks;
+        track = image[block];
+        sector = image[block + 1];
+    }
+    return blocks;
+}
+
+/**
+ * This function marks as used the sectors of the image, as told by the BAM,
+ * but the ones of the files that are going to be written again (cc1541
+ * replaces them). On a new image, only the directory track is used.
+ */
+static void read_bam(void)
+{
+    static unsigned char chain[MAX_BLOCKS][2];
+    long bam = offset(DIRECTORY_TRACK, BAM_SECTOR);
+    int track;
+    int sector;
+    int i;
+
+    for (track = 1; track <= MAX_TRACKS; ++track) {
+        for (sector = 0; sector < sectors(track); ++sector) {
+            if (track == DIRECTORY_TRACK) {
+                used[track][sector] = 1;
+            } else if (image_size > 0 && track <= 35) {
+                used[track][sector] = !(image[bam + 4 * track + 1 + sector / 8] & (1 << (sector % 8)));
+            } else {
+                used[track][sector] = (image_size > 0 && track > tracks);
+            }
+        }
+    }
+
+    for (i = 0; i < file_count && image_size > 0; ++i) {
+        long entry = find(files[i].name, NULL);
+        int blocks = entry < 0 ? 0 : read_chain(entry, chain);
+        int j;
+        for (j = 0; j < blocks; ++j) {
+            used[chain[j][0]][chain[j][1]] = 0;
+        }
+    }
+}
+
+/****************************************************************************
+ ** MODEL FUNCTIONS
+ ****************************************************************************/
+
+/**
+ * This function returns the time taken by the head to move from the track
+ * "from" to the track "to".
+ */
+static double seek_ms(int from, int to)
+{
+    int steps = from > to ? from - to : to - from;
+
+    return steps ? SETTLE_MS + steps * STEP_MS : 0.0;
+}
+
+/**
+ * This function returns the time between the start of a sector of the
+ * track "track" and the start of the one "distance" sectors later, when
+ * this one can be read only after that the first one has been sent.
+ */
+static double gap_ms(int track, int distance)
+{
+    double sector_ms = REVOLUTION_MS / sectors(track);
+    double gap = distance * sector_ms;
+
+    while (gap < sector_ms + block_ms) {
+        gap += REVOLUTION_MS;
+    }
+    return gap;
+}
+
+/**
+ * This function returns the interleave that gives the shortest time
+ * between two blocks on the track "track", with the loader in use.
+ */
+static int best_interleave(int track)
+{
+    int best = 1;
+    int distance;
+
+    for (distance = 2; distance < sectors(track); ++distance) {
+        if (gap_ms(track, distance) < gap_ms(track, best)) {
+            best = distance;
+        }
+    }
+    return best;
+}
+
+/****************************************************************************
+ ** SEQUENCE FUNCTIONS
+ ****************************************************************************/
+
+/**
+ * This function reads the sequence of loads from the file "name". It
+ * returns 0 if it cannot be read.
+ */
+static int read_sequence(const char* name)
+{
+    FILE* f = fopen(name, "r");
+    int comment = 0;
+    int length = 0;
+    int c;
+
+    if (f == NULL) {
+        perror(name);
+        return 0;
+    }
+    do {
+        c = fgetc(f);
+        if (c == '#') {
+            comment = 1;
+        } else if (c == '\n') {
+            comment = 0;
+        }
+        if (c == EOF || comment || isspace(c)) {
+            if (length > 0 && load_count < MAX_LOADS) {
+                loads[load_count++][length] = 0;
+            }
+            length = 0;
+        } else if (length < MAX_NAME - 1 && load_count < MAX_LOADS) {
+            loads[load_count][length++] = (char)c;
+        }
+    } while (c != EOF);
+    fclose(f);
+    return 1;
+}
+
+/**
+ * This function returns the number of times the file "b" is loaded just
+ * after the file "a" (or vice versa).
+ */
+static int transitions(const char* a, const char* b)
+{
+    int result = 0;
+    int i;
+
+    for (i = 1; i < load_count; ++i) {
+        if ((strcmp(loads[i - 1], a) == 0 && strcmp(loads[i], b) == 0) ||
+                    (strcmp(loads[i - 1], b) == 0 && strcmp(loads[i], a) == 0)) {
+            ++result;
+        }
+    }
+    return result;
+}
+
+/**
+ * This function sorts the files in the order they will be placed: first
+ * the one loaded most often, then the one loaded most often just before or
+ * after the last one placed (or, if none, the one loaded most often), and
+ * so on. Files that are never loaded go last, as given.
+ */
+static void sort_files(void)
+{
+    int i;
+    int j;
+
+    for (i = 0; i < file_count; ++i) {
+        files[i].loads = 0;
+        for (j = 0; j < load_count; ++j) {
+            if (strcmp(loads[j], files[i].name) == 0) {
+                ++files[i].loads;
+            }
+        }
+    }
+
+    for (i = 0; i < file_count; ++i) {
+        int best = i;
+        int best_transitions = -1;
+        layout_file swap;
+        for (j = i; j < file_count; ++j) {
+            int t = i > 0 ? transitions(files[i - 1].name, files[j].name) : 0;
+            if (t > best_transitions || (t == best_transitions && files[j].loads > files[best].loads)) {
+                best = j;
+                best_transitions = t;
+            }
+        }
+        swap = files[i];
+        files[i] = files[best];
+        files[best] = swap;
+    }
+}
+
+/****************************************************************************
+ ** COMMANDS SECTION
+ ****************************************************************************/
+
+/**
+ * This function places the files from the first track above the directory
+ * on, one after the other: each one starts where the previous one ended
+ * (plus the interleave), so they are read with the fewest seeks.
+ */
+static void place_files(void)
+{
+    int track = DIRECTORY_TRACK + 1;
+    int sector = 0;
+    int i;
+    int j;
+
+    for (i = 0; i < file_count; ++i) {
+        layout_file* file = &files[i];
+
+        file->interleave = best_interleave(track);
+        for (j = 0; j < file->blocks; ++j) {
+            int k;
+            // The next free sector, from the one after the interleave on;
+            // otherwise the next track.
+            for (k = 0; k < sectors(track) && used[track][(sector + k) % sectors(track)]; ++k) {
+            }
+            while (k == sectors(track) && track < tracks) {
+                ++track;
+                sector %= sectors(track);
+                for (k = 0; k < sectors(track) && used[track][(sector + k) % sectors(track)]; ++k) {
+                }
+            }
+            sector = (sector + k) % sectors(track);
+            if (j == 0) {
+                file->track = track;
+                file->sector = sector;
+            }
+            used[track][sector] = 1;
+            sector = (sector + file->interleave) % sectors(track);
+        }
+    }
+}
+
+/**
+ * This function prints the estimated cost of the layout of the image, for
+ * each file of the sequence and for the whole sequence. It returns 0 if a
+ * file cannot be read.
+ */
+static int estimate(void)
+{
+    static unsigned char chain[MAX_BLOCKS][2];
+    double total_seek = 0.0;
+    double total_rotation = 0.0;
+    double total_transfer = 0.0;
+    int head = DIRECTORY_TRACK;
+    int counted = 0;
+    int i;
+    int j;
+
+    printf("ovllayout: %-16s %6s %7s %6s %10s %9s\n", "file", "blocks", "tracks", "first", "interleave", "ms/load");
+
+    for (i = 0; i < load_count; ++i) {
+        const char* name = loads[i];
+        double seek = 0.0;
+        double rotation = 0.0;
+        double transfer = 0.0;
+        long entry;
+        int index = 0;
+        int blocks;
+        int from;
+
+        entry = find(name, &index);
+        if (entry < 0) {
+            continue;
+        }
+        blocks = read_chain(entry, chain);
+        if (blocks < 0) {
+            fprintf(stderr, "ovllayout: the blocks of \"%s\" are broken\n", name);
+            return 0;
+        }
+
+        // The file is looked for into the directory, unless loaded by
+        // position.
+        from = head;
+        if (!direct) {
+            seek += seek_ms(head, DIRECTORY_TRACK);
+            rotation += REVOLUTION_MS / 2 + index * gap_ms(DIRECTORY_TRACK, 3);
+            from = DIRECTORY_TRACK;
+        }
+        for (j = 0; j < blocks; ++j) {
+            int track = chain[j][0];
+            if (j == 0 || track != chain[j - 1][0]) {
+                seek += seek_ms(j == 0 ? from : chain[j - 1][0], track);
+                rotation += REVOLUTION_MS / 2;
+            } else {
+                int distance = (chain[j][1] - chain[j - 1][1] + sectors(track)) % sectors(track);
+                rotation += gap_ms(track, distance ? distance : sectors(track)) - block_ms;
+            }
+            if (j == blocks - 1) {
+                rotation += REVOLUTION_MS / sectors(track);
+            }
+            transfer += block_ms;
+        }
+        if (blocks > 0) {
+            head = chain[blocks - 1][0];
+        }
+
+        // Each file is printed once, at its first load.
+        for (j = 0; j < i && strcmp(loads[j], name) != 0; ++j) {
+        }
+        if (j == i) {
+            int last = blocks > 0 ? chain[blocks - 1][0] : 0;
+            int interleave = 0;
+            char span[16];
+            char first[16];
+            if (blocks > 1 && chain[1][0] == chain[0][0]) {
+                interleave = (chain[1][1] - chain[0][1] + sectors(chain[0][0])) % sectors(chain[0][0]);
+            }
+            snprintf(span, sizeof(span), "%d-%d", blocks ? chain[0][0] : 0, last);
+            snprintf(first, sizeof(first), "%d/%d", blocks ? chain[0][0] : 0, blocks ? chain[0][1] : 0);
+            printf("ovllayout: %-16s %6d %7s %6s %10d %9.0f\n", name, blocks, span, first, interleave, seek + rotation + transfer);
+        }
+
+        total_seek += seek;
+        total_rotation += rotation;
+        total_transfer += transfer;
+        ++counted;
+    }
+
+    printf("ovllayout: %d loads: seek %.0f ms, rotation %.0f ms, transfer %.0f ms, total %.0f ms\n",
+                counted, total_seek, total_rotation, total_transfer, total_seek + total_rotation + total_transfer);
+    return 1;
+}
+
+/**
+ * This function writes the files on the image "name" by running "cc1541",
+ * placed as told by the layout. It returns 0 if any error occours.
+ */
+static int write_files(const char* cc1541, const char* name)
+{
+    static char command[MAX_COMMAND];
+    size_t length;
+    int i;
+
+    length = (size_t)snprintf(command, sizeof(command), "\"%s\"", cc1541);
+    for (i = 0; i < file_count && length < sizeof(command); ++i) {
+        length += (size_t)snprintf(command + length, sizeof(command) - length, " -s %d -r %d -b %d -f %s -w \"%s\"",
+                    files[i].interleave, files[i].track, files[i].sector, files[i].name, files[i].path);
+    }
+    if (length < sizeof(command)) {
+        length += (size_t)snprintf(command + length, sizeof(command) - length, " \"%s\"", name);
+    }
+    if (length >= sizeof(command)) {
+        fprintf(stderr, "ovllayout: too many files\n");
+        return 0;
+    }
+
+    printf("%s\n", command);
+    fflush(stdout);
+    if (system(command) != 0) {
+        fprintf(stderr, "ovllayout: cc1541 failed\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * This function reads the "<name>=<file>" arguments into the files to
+ * write, measuring each file. It returns 0 if any error occours.
+ */
+static int read_files(int count, char* arguments[])
+{
+    int i;
+
+    for (i = 0; i < count; ++i) {
+        char* path = strchr(arguments[i], '=');
+        FILE* f;
+        long size;
+
+        if (path == NULL || path == arguments[i] || path - arguments[i] >= MAX_NAME || file_count >= MAX_FILES) {
+            fprintf(stderr, "ovllayout: invalid file \"%s\"\n", arguments[i]);
+            return 0;
+        }
+        f = fopen(path + 1, "rb");
+        if (f == NULL) {
+            perror(path + 1);
+            return 0;
+        }
+        fseek(f, 0, SEEK_END);
+        size = ftell(f);
+        fclose(f);
+
+        memcpy(files[file_count].name, arguments[i], (size_t)(path - arguments[i]));
+        files[file_count].name[path - arguments[i]] = 0;
+        files[file_count].path = path + 1;
+        files[file_count].blocks = size > 0 ? (int)((size + BLOCK_DATA - 1) / BLOCK_DATA) : 1;
+        ++file_count;
+    }
+    return 1;
+}
+
+int main(int argc, char* argv[])
+{
+    int write = argc > 1 && strcmp(argv[1], "write") == 0;
+    int first = 2;
+
+    if (argc > first && strcmp(argv[first], "-d") == 0) {
+        direct = 1;
+        ++first;
+    }
+    if (argc > first && strcmp(argv[first], "fast") == 0) {
+        block_ms = FAST_BLOCK_MS;
+    } else if (argc <= first || strcmp(argv[first], "kernal") != 0) {
+        argc = 0;
+    }
+
+    if (argc == first + 3 && strcmp(argv[1], "cost") == 0) {
+        if (!read_sequence(argv[first + 1])) {
+            return EXIT_FAILURE;
+        }
+        if (!read_image(argv[first + 2])) {
+            fprintf(stderr, "ovllayout: cannot read \"%s\"\n", argv[first + 2]);
+            return EXIT_FAILURE;
+        }
+        return estimate() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (write && argc >= first + 5) {
+        if (!read_sequence(argv[first + 1]) || !read_files(argc - first - 4, argv + first + 4)) {
+            return EXIT_FAILURE;
+        }
+        // The image may not exist yet.
+        if (!read_image(argv[first + 2])) {
+            image_size = 0;
+            tracks = 35;
+        }
+        read_bam();
+        sort_files();
+        place_files();
+        if (!write_files(argv[first + 3], argv[first + 2])) {
+            return EXIT_FAILURE;
+        }
+        if (!read_image(argv[first + 2])) {
+            fprintf(stderr, "ovllayout: cannot read \"%s\"\n", argv[first + 2]);
+            return EXIT_FAILURE;
+        }
+        return estimate() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "usage: %s write [-d] kernal|fast <sequence> <disk image> <cc1541> <name>=<file> [...]\n", argv[0]);
+    fprintf(stderr, "       %s cost [-d] kernal|fast <sequence> <disk image>\n", argv[0]);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,176 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * HOST TOOL: OVERLAY MODULES COMPRESSOR                                    *
+ ****************************************************************************/
+
+// This program is executed on the host (not on the retrocomputer) during
+// the build. It compresses a module produced by the linker (a binary file
+// whose first two bytes are the load address) with a simple LZ77 scheme,
+// that can be decompressed "in place" while the bytes are read from the
+// mass storage: the back references point to the bytes already written
+// into the overlay area, so no other buffer is needed.
+//
+// The format of the compressed file is the following:
+//
+//   - 2 bytes: load address (low, high) of the uncompressed module;
+//   - a sequence of tokens:
+//      0LLLLLLL                  : L literal bytes follow (L = 1...127);
+//      1LLLLOOO OOOOOOOO         : copy L + 3 bytes (3...18) from the
+//                                  O + 1 bytes before (1...2048);
+//      00000000                  : end of the module.
+//
+// Usage: ovlpack <module file> <compressed file>
+
+/****************************************************************************
+ ** INCLUDE SECTION
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/****************************************************************************
+ ** DEFINITIONS SECTION
+ ****************************************************************************/
+
+// Maximum size of a module (the whole address space).
+#define MAX_MODULE      65536
+
+// Limits of the format.
+#define MAX_LITERALS    127
+#define MIN_MATCH       3
+#define MAX_MATCH       (15 + MIN_MATCH)
+#define MAX_OFFSET      2048
+
+// Size of the data part of a block on a 1541 disk.
+#define BLOCK_SIZE      254
+
+/****************************************************************************
+ ** VARIABLES SECTION
+ ****************************************************************************/
+
+static unsigned char input[MAX_MODULE + 2];
+static unsigned char output[MAX_MODULE * 2];
+static long output_size = 0;
+
+/****************************************************************************
+ ** FUNCTIONS SECTION
+ ****************************************************************************/
+
+/**
+ * This function writes the pending literals (from "start", "count" bytes).
+ */
+static void flush_literals(const unsigned char* start, long count)
+{
+    while (count > 0) {
+        long run = count > MAX_LITERALS ? MAX_LITERALS : count;
+        long i;
+        output[output_size++] = (unsigned char)run;
+        for (i = 0; i < run; ++i) {
+            output[output_size++] = start[i];
+        }
+        start += run;
+        count -= run;
+    }
+}
+
+/**
+ * This function compresses "size" bytes of "data".
+ */
+static void compress(const unsigned char* data, long size)
+{
+    long position = 0;
+    long literals = 0;
+
+    while (position < size) {
+        long best_length = 0;
+        long best_offset = 0;
+        long offset;
+
+        // Brute force search of the longest match: modules are small.
+        for (offset = 1; offset <= MAX_OFFSET && offset <= position; ++offset) {
+            long length = 0;
+            while (length < MAX_MATCH && position + length < size &&
+                        data[position + length] == data[position + length - offset]) {
+                ++length;
+            }
+            if (length > best_length) {
+                best_length = length;
+                best_offset = offset;
+                if (length == MAX_MATCH) {
+                    break;
+                }
+            }
+        }
+
+        if (best_length >= MIN_MATCH) {
+            flush_literals(data + position - literals, literals);
+            literals = 0;
+            output[output_size++] = (unsigned char)(0x80 | ((best_length - MIN_MATCH) << 3) | ((best_offset - 1) >> 8));
+            output[output_size++] = (unsigned char)((best_offset - 1) & 0xff);
+            position += best_length;
+        } else {
+            ++literals;
+            ++position;
+        }
+    }
+
+    flush_literals(data + position - literals, literals);
+    output[output_size++] = 0;
+}
+
+/**
+ * This function returns the number of 1541 blocks used by "size" bytes.
+ */
+static long blocks(long size)
+{
+    return (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* in;
+    FILE* out;
+    long size;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <module file> <compressed file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    in = fopen(argv[1], "rb");
+    if (in == NULL) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    size = (long)fread(input, 1, sizeof(input), in);
+    fclose(in);
+
+    if (size < 2) {
+        fprintf(stderr, "%s: missing load address\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    // The load address is copied as is.
+    output[output_size++] = input[0];
+    output[output_size++] = input[1];
+
+    compress(input + 2, size - 2);
+
+    out = fopen(argv[2], "wb");
+    if (out == NULL) {
+        perror(argv[2]);
+        return EXIT_FAILURE;
+    }
+    if (fwrite(output, 1, (size_t)output_size, out) != (size_t)output_size || fclose(out) != 0) {
+        perror(argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    printf("ovlpack: %s: %ld -> %ld bytes (%ld -> %ld blocks)\n",
+                argv[1], size, output_size, blocks(size), blocks(output_size));
+
+    return EXIT_SUCCESS;
+}
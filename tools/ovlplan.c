@@ -0,0 +1,451 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * HOST TOOL: OVERLAY MODULES PLANNER                                       *
+ ****************************************************************************/
+
+// This program is executed on the host (not on the retrocomputer). It
+// proposes how to group the overlayed functions into modules, so that the
+// number of modules loaded along the main control flow of the program is
+// as small as possible, while each module fits into the given size.
+//
+// Since the "code-name" and "rodata-name" pragmas act on a whole source
+// file, the unit of the assignment is the source file: all the functions
+// defined with the OVERLAYED() macro into the same file go together (so,
+// to get a finer assignment, split the file). The inputs are:
+//
+//   - the map file produced by the linker (see _mapfile_ into the
+//     makefile) for the single executable: the size of each source file
+//     is the size of its CODE and RODATA segments (or of its OVERLAYn
+//     segment, if the map comes from the overlayed executable);
+//   - the "flow" file: the sequence of the overlayed functions called
+//     along the main control flow, one or more per line (a "#" starts a
+//     comment). Two consecutive calls of functions defined into different
+//     files are a transition between them: the more transitions, the more
+//     the two files should stay into the same module;
+//   - the source files, where the functions defined with OVERLAYED() are
+//     looked for.
+//
+// Files are grouped by joining, each time, the two groups with the most
+// transitions between them whose total size still fits. Then the tool
+// prints the loads along the flow (with a single slot) before and after,
+// and the pragmas and the annotations for the include file (that are used
+// by the "ovlstub" tool) for each module.
+//
+// Usage: ovlplan <map file> <module size> <flow file> <source> [<source> ...]
+
+/****************************************************************************
+ ** INCLUDE SECTION
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/****************************************************************************
+ ** DEFINITIONS SECTION
+ ****************************************************************************/
+
+// Maximum length of a single line of the input files.
+#define MAX_LINE        512
+
+// Maximum length of a name (of a function or of a file).
+#define MAX_NAME        64
+
+// Maximum length of a prototype.
+#define MAX_PROTOTYPE   (MAX_LINE + MAX_NAME)
+
+// Maximum number of source files and of functions.
+#define MAX_FILES       64
+#define MAX_FUNCTIONS   256
+
+// Maximum number of calls into the flow.
+#define MAX_CALLS       4096
+
+// Macro used to define the overlayed functions.
+#define OVERLAYED       "OVERLAYED("
+
+/****************************************************************************
+ ** VARIABLES SECTION
+ ****************************************************************************/
+
+// Source files with overlayed functions: name (without path and extension),
+// size, group they belong to, and prototype of their functions.
+static char file_names[MAX_FILES][MAX_NAME];
+static long file_sizes[MAX_FILES];
+static int file_groups[MAX_FILES];
+static int files = 0;
+
+// Overlayed functions: name, file and prototype (as it must appear into the
+// include file).
+static char function_names[MAX_FUNCTIONS][MAX_NAME];
+static char function_prototypes[MAX_FUNCTIONS][MAX_PROTOTYPE];
+static int function_files[MAX_FUNCTIONS];
+static int functions = 0;
+
+// Files of the functions called along the flow.
+static int calls[MAX_CALLS];
+static int call_count = 0;
+
+// Transitions between each pair of files.
+static long transitions[MAX_FILES][MAX_FILES];
+
+/****************************************************************************
+ ** FUNCTIONS SECTION
+ ****************************************************************************/
+
+/**
+ * This function copies into "result" the name of the file "path", without
+ * the directories and the extension.
+ */
+static void base_name(const char* path, char* result)
+{
+    const char* start = path;
+    const char* p;
+    size_t length;
+
+    for (p = path; *p; ++p) {
+        if (*p == '/' || *p == '\\' || *p == ':') {
+            start = p + 1;
+        }
+    }
+    p = strrchr(start, '.');
+    length = p ? (size_t)(p - start) : strlen(start);
+    if (length >= MAX_NAME) {
+        length = MAX_NAME - 1;
+    }
+    memcpy(result, start, length);
+    result[length] = 0;
+}
+
+/**
+ * This function looks for the function definitions made by the OVERLAYED()
+ * macro into the source file "path". It returns 0 if the file cannot be
+ * read.
+ */
+static int read_source(const char* path)
+{
+    char line[MAX_LINE];
+    FILE* f = fopen(path, "r");
+    int file = -1;
+
+    if (f == NULL) {
+        perror(path);
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char* macro = strstr(line, OVERLAYED);
+        char* end;
+        char* rest;
+        size_t length;
+
+        // Only definitions (that start at the beginning of the line) are
+        // considered, not the declarations into the module descriptors.
+        if (macro == NULL || isspace((unsigned char)line[0]) || strchr(line, ';') != NULL) {
+            continue;
+        }
+        end = strchr(macro, ')');
+        if (end == NULL || functions == MAX_FUNCTIONS) {
+            continue;
+        }
+        if (file < 0) {
+            if (files == MAX_FILES) {
+                break;
+            }
+            file = files++;
+            base_name(path, file_names[file]);
+            file_sizes[file] = 0;
+        }
+
+        length = (size_t)(end - macro) - strlen(OVERLAYED);
+        if (length >= MAX_NAME) {
+            length = MAX_NAME - 1;
+        }
+        memcpy(function_names[functions], macro + strlen(OVERLAYED), length);
+        function_names[functions][length] = 0;
+
+        // The prototype is the definition with the real name of the
+        // function.
+        rest = end + 1;
+        rest[strcspn(rest, "{\r\n")] = 0;
+        while (*rest && isspace((unsigned char)rest[strlen(rest) - 1])) {
+            rest[strlen(rest) - 1] = 0;
+        }
+        *macro = 0;
+        snprintf(function_prototypes[functions], MAX_PROTOTYPE, "%s%s%s;", line, function_names[functions], rest);
+
+        function_files[functions++] = file;
+    }
+
+    fclose(f);
+    return 1;
+}
+
+/**
+ * This function returns the index of the file named "name", or -1.
+ */
+static int find_file(const char* name)
+{
+    int i;
+
+    for (i = 0; i < files; ++i) {
+        if (strcmp(file_names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * This function reads the sizes of the source files from the "Modules list"
+ * of the map file "path". It returns 0 if the file cannot be read.
+ */
+static int read_map(const char* path)
+{
+    char line[MAX_LINE];
+    FILE* f = fopen(path, "r");
+    int listing = 0;
+    int file = -1;
+
+    if (f == NULL) {
+        perror(path);
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char segment[MAX_NAME];
+        char* size;
+
+        if (strncmp(line, "Modules list", 12) == 0) {
+            listing = 1;
+            continue;
+        }
+        if (!listing) {
+            continue;
+        }
+        if (strncmp(line, "Segment list", 12) == 0) {
+            break;
+        }
+        if (!isspace((unsigned char)line[0]) && strchr(line, ':') != NULL && line[0] != '-') {
+            char name[MAX_NAME];
+            // Modules taken from a library have the form "library(module)".
+            *strrchr(line, ':') = 0;
+            base_name(strchr(line, '(') ? strchr(line, '(') + 1 : line, name);
+            file = find_file(name);
+            continue;
+        }
+        size = strstr(line, "Size=");
+        if (file < 0 || size == NULL || sscanf(line, " %63s", segment) != 1) {
+            continue;
+        }
+        if (strcmp(segment, "CODE") == 0 || strcmp(segment, "RODATA") == 0 ||
+                    strncmp(segment, "OVERLAY", 7) == 0) {
+            file_sizes[file] += strtol(size + 5, NULL, 16);
+        }
+    }
+
+    fclose(f);
+    return 1;
+}
+
+/**
+ * This function reads the sequence of the functions called along the flow
+ * from the file "path". It returns 0 if the file cannot be read.
+ */
+static int read_flow(const char* path)
+{
+    char line[MAX_LINE];
+    FILE* f = fopen(path, "r");
+
+    if (f == NULL) {
+        perror(path);
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char* token;
+        line[strcspn(line, "#")] = 0;
+        for (token = strtok(line, " \t\r\n"); token != NULL; token = strtok(NULL, " \t\r\n")) {
+            int i;
+            for (i = 0; i < functions; ++i) {
+                if (strcmp(function_names[i], token) == 0) {
+                    break;
+                }
+            }
+            if (i == functions) {
+                fprintf(stderr, "%s: function \"%s\" is not overlayed\n", path, token);
+                continue;
+            }
+            if (call_count < MAX_CALLS) {
+                calls[call_count++] = function_files[i];
+            }
+        }
+    }
+
+    fclose(f);
+    return 1;
+}
+
+/**
+ * This function returns the number of loads along the flow, with a single
+ * slot, if each file is into the module given by its group.
+ */
+static long loads(void)
+{
+    long result = 0;
+    int current = -1;
+    int i;
+
+    for (i = 0; i < call_count; ++i) {
+        if (file_groups[calls[i]] != current) {
+            current = file_groups[calls[i]];
+            ++result;
+        }
+    }
+    return result;
+}
+
+/**
+ * This function returns the size of the group "group".
+ */
+static long group_size(int group)
+{
+    long result = 0;
+    int i;
+
+    for (i = 0; i < files; ++i) {
+        if (file_groups[i] == group) {
+            result += file_sizes[i];
+        }
+    }
+    return result;
+}
+
+/**
+ * This function joins the groups of files, as long as it is possible.
+ */
+static void partition(long limit)
+{
+    for (;;) {
+        long best = 0;
+        int best_a = -1;
+        int best_b = -1;
+        int a;
+        int b;
+
+        for (a = 0; a < files; ++a) {
+            for (b = 0; b < files; ++b) {
+                long weight = 0;
+                int i;
+                int j;
+                if (a >= b || file_groups[a] != a || file_groups[b] != b) {
+                    continue;
+                }
+                for (i = 0; i < files; ++i) {
+                    for (j = 0; j < files; ++j) {
+                        if (file_groups[i] == a && file_groups[j] == b) {
+                            weight += transitions[i][j] + transitions[j][i];
+                        }
+                    }
+                }
+                if (weight > best && group_size(a) + group_size(b) <= limit) {
+                    best = weight;
+                    best_a = a;
+                    best_b = b;
+                }
+            }
+        }
+
+        if (best_a < 0) {
+            break;
+        }
+        for (a = 0; a < files; ++a) {
+            if (file_groups[a] == best_b) {
+                file_groups[a] = best_a;
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    long limit;
+    long before;
+    int module;
+    int group;
+    int i;
+
+    if (argc < 5) {
+        fprintf(stderr, "usage: %s <map file> <module size> <flow file> <source> [<source> ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // The size can be given in decimal or in hexadecimal ("$" or "0x").
+    limit = argv[2][0] == '$' ? strtol(argv[2] + 1, NULL, 16) : strtol(argv[2], NULL, 0);
+    if (limit <= 0) {
+        fprintf(stderr, "%s: invalid module size \"%s\"\n", argv[0], argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    for (i = 4; i < argc; ++i) {
+        if (!read_source(argv[i])) {
+            return EXIT_FAILURE;
+        }
+    }
+    if (functions == 0) {
+        fprintf(stderr, "%s: no overlayed functions found\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!read_map(argv[1]) || !read_flow(argv[3])) {
+        return EXIT_FAILURE;
+    }
+
+    for (i = 1; i < call_count; ++i) {
+        if (calls[i] != calls[i - 1]) {
+            ++transitions[calls[i - 1]][calls[i]];
+        }
+    }
+
+    // At the beginning, every file is a module by itself.
+    for (i = 0; i < files; ++i) {
+        file_groups[i] = i;
+        if (file_sizes[i] == 0) {
+            fprintf(stderr, "%s: size of \"%s\" not found into the map\n", argv[1], file_names[i]);
+        } else if (file_sizes[i] > limit) {
+            fprintf(stderr, "%s: \"%s\" (%ld bytes) does not fit into a module\n", argv[0], file_names[i], file_sizes[i]);
+        }
+    }
+    before = loads();
+
+    partition(limit);
+
+    printf("// Loads along the flow: %ld with a module for each file, %ld with the modules below.\n",
+                before, loads());
+
+    module = 0;
+    for (group = 0; group < files; ++group) {
+        if (file_groups[group] != group) {
+            continue;
+        }
+        ++module;
+        printf("\n// MODULE %d (%ld bytes of %ld)\n//\n// Into", module, group_size(group), limit);
+        for (i = 0; i < files; ++i) {
+            if (file_groups[i] == group) {
+                printf(" %s.c", file_names[i]);
+            }
+        }
+        printf(":\n//\n//    #pragma code-name (\"OVERLAY%d\");\n//    #pragma rodata-name (\"OVERLAY%d\");\n//\n", module, module);
+        printf("// Into the include file:\n\n// OVERLAYED FUNCTIONS (MODULE %d)\n", module);
+        for (i = 0; i < functions; ++i) {
+            if (file_groups[function_files[i]] == group) {
+                printf("%s\n", function_prototypes[i]);
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,624 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * HOST TOOL: OVERLAY PROFILER                                              *
+ ****************************************************************************/
+
+// This program is executed on the host (not on the retrocomputer) by the
+// "profile" target of the makefile, around a run of the profile build of
+// the program into the emulator. It has two commands:
+//
+//   ovlprof monitor <debug file> <trace> <commands>
+//
+// writes the commands for the monitor of VICE (to be given with the
+// -moncommands option) that trace the execution of the whole program into
+// the file "trace". The addresses are taken from the debug file written by
+// the linker (--dbgfile);
+//
+//   ovlprof report <debug file> <trace> [<threshold>]
+//
+// reads the trace and charges the time of each instruction to the function
+// that contains it: a flat profile and a summary for each module are
+// printed. The overlaid functions that take more than "threshold" percent
+// of the time (default: 5) are marked as candidates for the resident part.
+//
+// Each line of the trace that starts with ".C:" and an address (as written
+// by the monitor for a tracepoint, or by its "chis" command), or with just
+// an address, is a sample of the program counter. If the line ends with the
+// clock of the CPU, the sample is charged the cycles until the next sample
+// (so the time spent into the ROM, that is not traced, is charged to the
+// function that called it), otherwise it counts as one.
+//
+// All the modules are linked at the same addresses, so the address is not
+// enough to tell which module is running. The profile build calls the byte
+// number "module" of "ovlmarks" (a table of "rts", see ovlcall.s) every
+// time a module is made present: the samples of those bytes tell that the
+// module is into the overlay area, and that the modules that overlap with
+// it are not there anymore.
+
+/****************************************************************************
+ ** INCLUDE SECTION
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/****************************************************************************
+ ** DEFINITIONS SECTION
+ ****************************************************************************/
+
+// Maximum number of segments and of symbols read from the debug file.
+#define MAX_SEGMENTS        64
+#define MAX_SYMBOLS         8192
+
+// Maximum length of a line, and of a name.
+#define MAX_LINE            512
+#define MAX_NAME            64
+
+// Prefix of the names of the segments of the modules (followed by their
+// number), and name of the table of marks.
+#define OVERLAY_PREFIX      "OVERLAY"
+#define MARKS_SYMBOL        "ovlmarks"
+
+// Number of marks, as reserved into ovlcall.s.
+#define MARKS               32
+
+// Default threshold, in percent.
+#define THRESHOLD           5.0
+
+// A segment of the program.
+typedef struct segment {
+    char name[MAX_NAME];
+    long start;
+    long size;
+    int module;             // Number of the module (0 = resident).
+    int present;            // The module is into the overlay area.
+    unsigned long marks;    // Times the module has been made present.
+    unsigned long samples;
+    unsigned long cycles;
+} segment;
+
+// A label of the program, with the time charged to it (up to the next
+// label of the same segment).
+typedef struct symbol {
+    char name[MAX_NAME];
+    long value;
+    int segment;            // Index into the segments.
+    unsigned long samples;
+    unsigned long cycles;
+} symbol;
+
+/****************************************************************************
+ ** VARIABLES SECTION
+ ****************************************************************************/
+
+static segment segments[MAX_SEGMENTS];
+static int segment_count = 0;
+
+static symbol symbols[MAX_SYMBOLS];
+static int symbol_count = 0;
+
+// Address of the table of marks (-1 if not found).
+static long marks = -1;
+
+// Time spent outside of any segment, or into the overlay area when no
+// module there is known to be present.
+static unsigned long outside_samples = 0;
+static unsigned long outside_cycles = 0;
+static unsigned long unknown_samples = 0;
+static unsigned long unknown_cycles = 0;
+
+// Total time of the trace, and whether it gave the clock of the CPU.
+static unsigned long total_samples = 0;
+static unsigned long total_cycles = 0;
+static int clocked = 0;
+
+/****************************************************************************
+ ** DEBUG FILE FUNCTIONS
+ ****************************************************************************/
+
+/**
+ * This function looks for the attribute "key" into the attributes "line"
+ * of a record of the debug file ("key=value,key="value",..."), and it
+ * copies its value (without quotes) into "value", of "size" bytes.
+ * It returns 0 if not found.
+ */
+static int attribute(const char* line, const char* key, char* value, size_t size)
+{
+    size_t length = strlen(key);
+    const char* p = line;
+
+    while (*p) {
+        if (strncmp(p, key, length) == 0 && p[length] == '=') {
+            size_t i = 0;
+            int quoted = 0;
+            p += length + 1;
+            while (*p && *p != '\n' && (quoted || *p != ',')) {
+                if (*p == '"') {
+                    quoted = !quoted;
+                } else if (i + 1 < size) {
+                    value[i++] = *p;
+                }
+                ++p;
+            }
+            value[i] = 0;
+            return 1;
+        }
+        // Skip to the next attribute.
+        {
+            int quoted = 0;
+            while (*p && (quoted || *p != ',')) {
+                if (*p == '"') {
+                    quoted = !quoted;
+                }
+                ++p;
+            }
+            if (*p == ',') {
+                ++p;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * This function tells if "name" is a label generated by the compiler ("L"
+ * followed by hexadecimal digits), that would split the functions.
+ */
+static int is_internal(const char* name)
+{
+    if (name[0] != 'L' || !name[1]) {
+        return 0;
+    }
+    for (++name; *name; ++name) {
+        if (!isxdigit((unsigned char)*name)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * This function orders the symbols by segment and by value.
+ */
+static int compare_symbols(const void* a, const void* b)
+{
+    const symbol* first = (const symbol*)a;
+    const symbol* second = (const symbol*)b;
+
+    if (first->segment != second->segment) {
+        return first->segment - second->segment;
+    }
+    return first->value < second->value ? -1 : first->value > second->value;
+}
+
+/**
+ * This function reads the segments and the labels from the debug file
+ * "name". It returns 0 if any error occours.
+ */
+static int read_debug(const char* name)
+{
+    static int segment_ids[MAX_SEGMENTS];
+    static char records[MAX_SYMBOLS][MAX_LINE];
+    char line[MAX_LINE];
+    char value[MAX_NAME];
+    int record_count = 0;
+    int i;
+    FILE* f = fopen(name, "r");
+
+    if (f == NULL) {
+        perror(name);
+        return 0;
+    }
+
+    // The symbols refer to the segments by their id: so they are kept until
+    // all the segments have been read.
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, "seg\t", 4) == 0 && segment_count < MAX_SEGMENTS) {
+            segment* s = &segments[segment_count];
+            if (!attribute(line + 4, "id", value, sizeof(value))) {
+                continue;
+            }
+            segment_ids[segment_count] = atoi(value);
+            attribute(line + 4, "name", s->name, sizeof(s->name));
+            s->start = attribute(line + 4, "start", value, sizeof(value)) ? strtol(value, NULL, 0) : 0;
+            s->size = attribute(line + 4, "size", value, sizeof(value)) ? strtol(value, NULL, 0) : 0;
+            if (strncmp(s->name, OVERLAY_PREFIX, strlen(OVERLAY_PREFIX)) == 0) {
+                s->module = atoi(s->name + strlen(OVERLAY_PREFIX));
+            }
+            // The resident part is always present.
+            s->present = s->module == 0;
+            ++segment_count;
+        } else if (strncmp(line, "sym\t", 4) == 0 && record_count < MAX_SYMBOLS) {
+            if (attribute(line + 4, "type", value, sizeof(value)) && strcmp(value, "lab") == 0) {
+                strcpy(records[record_count++], line + 4);
+            }
+        }
+    }
+    fclose(f);
+
+    if (segment_count == 0) {
+        fprintf(stderr, "%s: no segments (is it a debug file?)\n", name);
+        return 0;
+    }
+
+    for (i = 0; i < record_count; ++i) {
+        symbol* s = &symbols[symbol_count];
+        int id;
+        int j;
+        if (!attribute(records[i], "name", s->name, sizeof(s->name)) || is_internal(s->name)) {
+            continue;
+        }
+        if (!attribute(records[i], "val", value, sizeof(value))) {
+            continue;
+        }
+        s->value = strtol(value, NULL, 0);
+        if (strcmp(s->name, MARKS_SYMBOL) == 0) {
+            marks = s->value;
+        }
+        if (!attribute(records[i], "seg", value, sizeof(value))) {
+            continue;
+        }
+        id = atoi(value);
+        for (j = 0; j < segment_count && segment_ids[j] != id; ++j) {
+        }
+        if (j == segment_count) {
+            continue;
+        }
+        s->segment = j;
+        ++symbol_count;
+    }
+    qsort(symbols, (size_t)symbol_count, sizeof(symbol), compare_symbols);
+    return 1;
+}
+
+/****************************************************************************
+ ** PROFILE FUNCTIONS
+ ****************************************************************************/
+
+/**
+ * This function marks the module "module" as present into the overlay
+ * area: the modules that overlap with it are not present anymore.
+ */
+static void mark(int module)
+{
+    int i;
+    int j;
+
+    for (i = 0; i < segment_count; ++i) {
+        if (segments[i].module != module) {
+            continue;
+        }
+        for (j = 0; j < segment_count; ++j) {
+            if (segments[j].module != 0 && segments[j].start < segments[i].start + segments[i].size
+                    && segments[i].start < segments[j].start + segments[j].size) {
+                segments[j].present = 0;
+            }
+        }
+        segments[i].present = 1;
+        ++segments[i].marks;
+    }
+}
+
+/**
+ * This function returns the segment (present into memory) that contains
+ * the address "address", or -1 if not found. If only the segments of
+ * modules not present contain it, "overlay" is set to 1.
+ */
+static int find_segment(long address, int* overlay)
+{
+    int i;
+
+    *overlay = 0;
+    for (i = 0; i < segment_count; ++i) {
+        if (address >= segments[i].start && address < segments[i].start + segments[i].size) {
+            if (segments[i].present) {
+                return i;
+            }
+            *overlay = 1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * This function returns the last label of the segment "index" that is not
+ * after the address "address", or -1 if there is none.
+ */
+static int find_symbol(int index, long address)
+{
+    int low = 0;
+    int high = symbol_count - 1;
+    int result = -1;
+
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        const symbol* s = &symbols[middle];
+        if (s->segment < index || (s->segment == index && s->value <= address)) {
+            if (s->segment == index) {
+                result = middle;
+            }
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return result;
+}
+
+/**
+ * This function charges "cycles" (and one sample) to the address "address".
+ */
+static void charge(long address, unsigned long cycles)
+{
+    int overlay;
+    int index = find_segment(address, &overlay);
+
+    ++total_samples;
+    total_cycles += cycles;
+
+    if (index < 0) {
+        if (overlay) {
+            ++unknown_samples;
+            unknown_cycles += cycles;
+        } else {
+            ++outside_samples;
+            outside_cycles += cycles;
+        }
+        return;
+    }
+    ++segments[index].samples;
+    segments[index].cycles += cycles;
+
+    index = find_symbol(index, address);
+    if (index >= 0) {
+        ++symbols[index].samples;
+        symbols[index].cycles += cycles;
+    }
+}
+
+/**
+ * This function parses a line of the trace: it returns the address of the
+ * sample (or -1 if the line is not a sample), and it writes the clock of
+ * the CPU into "clock" (or -1 if not given).
+ */
+static long parse_sample(const char* line, long* clock)
+{
+    const char* p = line;
+    const char* end;
+    char* after;
+    long address;
+
+    *clock = -1;
+    while (*p == ' ' || *p == '\t') {
+        ++p;
+    }
+    if (strncmp(p, ".C:", 3) == 0) {
+        p += 3;
+    } else if (*p == '.' || *p == '#') {
+        // Other CPUs (as the one of the drive), and the tracepoint headers.
+        return -1;
+    }
+    address = strtol(p, &after, 16);
+    if (after - p != 4 || (*after && !isspace((unsigned char)*after))) {
+        return -1;
+    }
+
+    // The clock, if any, is the last word of the line.
+    end = line + strlen(line);
+    while (end > after && isspace((unsigned char)end[-1])) {
+        --end;
+    }
+    p = end;
+    while (p > after && isdigit((unsigned char)p[-1])) {
+        --p;
+    }
+    if (p < end && p > after && isspace((unsigned char)p[-1])) {
+        *clock = strtol(p, NULL, 10);
+    }
+    return address;
+}
+
+/**
+ * This function reads the trace "name" and charges every sample. It
+ * returns 0 if any error occours.
+ */
+static int read_trace(const char* name)
+{
+    char line[MAX_LINE];
+    long last_address = -1;
+    long last_clock = -1;
+    FILE* f = fopen(name, "r");
+
+    if (f == NULL) {
+        perror(name);
+        return 0;
+    }
+
+    // Each sample is charged when the next one is read, since its cycles
+    // are the ones until the next sample. The marks are applied after the
+    // sample is charged, since the module is present only from then on.
+    while (fgets(line, sizeof(line), f) != NULL) {
+        long clock;
+        long address = parse_sample(line, &clock);
+        if (address < 0) {
+            continue;
+        }
+        if (last_address >= 0) {
+            if (last_clock >= 0 && clock >= last_clock) {
+                charge(last_address, (unsigned long)(clock - last_clock));
+                clocked = 1;
+            } else {
+                charge(last_address, 1);
+            }
+            if (marks >= 0 && last_address > marks && last_address < marks + MARKS) {
+                mark((int)(last_address - marks));
+            }
+        }
+        last_address = address;
+        last_clock = clock;
+    }
+    if (last_address >= 0) {
+        charge(last_address, 1);
+    }
+    fclose(f);
+
+    if (total_samples == 0) {
+        fprintf(stderr, "%s: no samples (did the emulator trace the program?)\n", name);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * This function returns the part of the whole time given by "cycles", in
+ * percent.
+ */
+static double percent(unsigned long cycles)
+{
+    return total_cycles ? (double)cycles * 100.0 / (double)total_cycles : 0.0;
+}
+
+/**
+ * This function orders the symbols by time, the longest first.
+ */
+static int compare_times(const void* a, const void* b)
+{
+    const symbol* first = (const symbol*)a;
+    const symbol* second = (const symbol*)b;
+
+    if (first->cycles != second->cycles) {
+        return first->cycles < second->cycles ? 1 : -1;
+    }
+    return strcmp(first->name, second->name);
+}
+
+/****************************************************************************
+ ** COMMANDS SECTION
+ ****************************************************************************/
+
+/**
+ * This function implements the "monitor" command.
+ */
+static int monitor(const char* debug_name, const char* trace_name, const char* commands_name)
+{
+    long first = 0xffff;
+    long last = 0;
+    FILE* f;
+    int i;
+
+    if (!read_debug(debug_name)) {
+        return EXIT_FAILURE;
+    }
+    if (marks < 0) {
+        fprintf(stderr, "%s: no \"%s\" (is it the profile build?)\n", debug_name, MARKS_SYMBOL);
+        return EXIT_FAILURE;
+    }
+
+    // The data segments are included too: only the instructions executed
+    // are traced.
+    for (i = 0; i < segment_count; ++i) {
+        if (segments[i].size == 0 || segments[i].start < 0x0100) {
+            continue;
+        }
+        if (segments[i].start < first) {
+            first = segments[i].start;
+        }
+        if (segments[i].start + segments[i].size - 1 > last) {
+            last = segments[i].start + segments[i].size - 1;
+        }
+    }
+
+    f = fopen(commands_name, "w");
+    if (f == NULL) {
+        perror(commands_name);
+        return EXIT_FAILURE;
+    }
+    fprintf(f, "logname \"%s\"\n", trace_name);
+    fprintf(f, "log on\n");
+    fprintf(f, "trace exec %04lx %04lx\n", first, last);
+    if (fclose(f) != 0) {
+        perror(commands_name);
+        return EXIT_FAILURE;
+    }
+    printf("ovlprof: tracing from $%04lx to $%04lx into %s\n", first, last, trace_name);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * This function implements the "report" command.
+ */
+static int report(const char* debug_name, const char* trace_name, double threshold)
+{
+    const char* unit;
+    unsigned long resident_samples = 0;
+    unsigned long resident_cycles = 0;
+    int candidates = 0;
+    int i;
+
+    if (!read_debug(debug_name) || !read_trace(trace_name)) {
+        return EXIT_FAILURE;
+    }
+    if (marks < 0) {
+        fprintf(stderr, "ovlprof: %s: no \"%s\", the modules cannot be told apart\n", debug_name, MARKS_SYMBOL);
+    }
+    unit = clocked ? "cycles" : "samples";
+
+    // The summary of the modules: the resident segments are summed.
+    printf("%-16s %12s %7s %10s %8s\n", "module", unit, "%", "samples", "marks");
+    for (i = 0; i < segment_count; ++i) {
+        if (segments[i].module == 0) {
+            resident_samples += segments[i].samples;
+            resident_cycles += segments[i].cycles;
+        }
+    }
+    printf("%-16s %12lu %6.2f%% %10lu %8s\n", "resident", resident_cycles, percent(resident_cycles), resident_samples, "-");
+    for (i = 0; i < segment_count; ++i) {
+        if (segments[i].module != 0) {
+            printf("%-16s %12lu %6.2f%% %10lu %8lu\n", segments[i].name, segments[i].cycles,
+                        percent(segments[i].cycles), segments[i].samples, segments[i].marks);
+        }
+    }
+    if (unknown_samples) {
+        printf("%-16s %12lu %6.2f%% %10lu %8s\n", "(no module)", unknown_cycles, percent(unknown_cycles), unknown_samples, "-");
+    }
+    if (outside_samples) {
+        printf("%-16s %12lu %6.2f%% %10lu %8s\n", "(outside)", outside_cycles, percent(outside_cycles), outside_samples, "-");
+    }
+    printf("%-16s %12lu %6.2f%% %10lu\n\n", "total", total_cycles, 100.0, total_samples);
+
+    // The flat profile.
+    qsort(symbols, (size_t)symbol_count, sizeof(symbol), compare_times);
+    printf("%-32s %-16s %12s %7s %10s\n", "function", "module", unit, "%", "samples");
+    for (i = 0; i < symbol_count && symbols[i].cycles > 0; ++i) {
+        const segment* s = &segments[symbols[i].segment];
+        const char* hot = "";
+        if (s->module != 0 && percent(symbols[i].cycles) >= threshold) {
+            hot = " *";
+            ++candidates;
+        }
+        printf("%-32s %-16s %12lu %6.2f%% %10lu%s\n", symbols[i].name, s->module ? s->name : "resident",
+                    symbols[i].cycles, percent(symbols[i].cycles), symbols[i].samples, hot);
+    }
+    if (candidates) {
+        printf("\n* overlaid, and more than %.1f%% of the time: a candidate for the resident part\n", threshold);
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 5 && strcmp(argv[1], "monitor") == 0) {
+        return monitor(argv[2], argv[3], argv[4]);
+    }
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "report") == 0) {
+        return report(argv[2], argv[3], argc == 5 ? atof(argv[4]) : THRESHOLD);
+    }
+    fprintf(stderr, "usage: %s monitor <debug file> <trace> <commands>\n", argv[0]);
+    fprintf(stderr, "       %s report <debug file> <trace> [<threshold>]\n", argv[0]);
+    return EXIT_FAILURE;
+}
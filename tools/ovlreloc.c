@@ -0,0 +1,142 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * HOST TOOL: OVERLAY MODULES RELOCATION TABLE                              *
+ ****************************************************************************/
+
+// This program is executed on the host (not on the retrocomputer) during
+// the build. It compares a module produced by the linker with the same
+// module produced by a second link, where the whole overlay area has been
+// moved up by one page (see "ovlsize shift"): the only bytes that differ
+// are the high bytes of the addresses that point into the module itself,
+// and each of them differs by one. So the module can be moved by any
+// number of pages at load time, by adding that number to those bytes.
+//
+// The offsets of those bytes (from the first byte after the load address)
+// are appended to the file that will be written on the disk (the module
+// compressed by "ovlpack"), after its end marker:
+//
+//   - 2 bytes: number of bytes of the table (low, high);
+//   - a sequence of distances, each from the byte patched before (from
+//     the byte before the module, at the beginning):
+//      1...255                   : the byte that far has to be patched;
+//      0                         : move 255 bytes on, without patching.
+//
+// A module must not hold the address of another module: it would be moved
+// together with this one (the text modules, that are reached through the
+// overlay manager, are an exception: see write_text() into main.c).
+//
+// Usage: ovlreloc <module file> <shifted module file> <file to extend>
+
+/****************************************************************************
+ ** INCLUDE SECTION
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/****************************************************************************
+ ** DEFINITIONS SECTION
+ ****************************************************************************/
+
+// Maximum size of a module (the whole address space).
+#define MAX_MODULE      65536
+
+// Size of the load address, at the beginning of a module.
+#define HEADER_SIZE     2
+
+// Largest distance of a single entry of the table.
+#define MAX_DISTANCE    255
+
+/****************************************************************************
+ ** VARIABLES SECTION
+ ****************************************************************************/
+
+static unsigned char module[MAX_MODULE + HEADER_SIZE];
+static unsigned char shifted[MAX_MODULE + HEADER_SIZE];
+static unsigned char table[MAX_MODULE * 2];
+
+/****************************************************************************
+ ** FUNCTIONS SECTION
+ ****************************************************************************/
+
+/**
+ * This function reads the file "path" into "buffer". It returns its size,
+ * or -1 if any error occours.
+ */
+static long read_file(const char* path, unsigned char* buffer)
+{
+    FILE* f = fopen(path, "rb");
+    long size;
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    size = (long)fread(buffer, 1, MAX_MODULE + HEADER_SIZE, f);
+    fclose(f);
+    return size;
+}
+
+int main(int argc, char* argv[])
+{
+    long size;
+    long shifted_size;
+    long last = -1;
+    long count = 0;
+    long patches = 0;
+    long i;
+    FILE* f;
+
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s <module file> <shifted module file> <file to extend>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    size = read_file(argv[1], module);
+    shifted_size = read_file(argv[2], shifted);
+    if (size < 0 || shifted_size < 0) {
+        return EXIT_FAILURE;
+    }
+    if (size != shifted_size || size < HEADER_SIZE) {
+        fprintf(stderr, "%s: the two links have different sizes\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    for (i = HEADER_SIZE; i < size; ++i) {
+        long distance;
+        if (module[i] == shifted[i]) {
+            continue;
+        }
+        if ((unsigned char)(module[i] + 1) != shifted[i]) {
+            fprintf(stderr, "%s: the byte at offset %ld cannot be relocated\n", argv[1], i - HEADER_SIZE);
+            return EXIT_FAILURE;
+        }
+        distance = (i - HEADER_SIZE) - last;
+        while (distance > MAX_DISTANCE) {
+            table[count++] = 0;
+            distance -= MAX_DISTANCE;
+        }
+        table[count++] = (unsigned char)distance;
+        last = i - HEADER_SIZE;
+        ++patches;
+    }
+
+    f = fopen(argv[3], "ab");
+    if (f == NULL) {
+        perror(argv[3]);
+        return EXIT_FAILURE;
+    }
+    fputc((int)(count & 0xff), f);
+    fputc((int)(count >> 8), f);
+    fwrite(table, 1, (size_t)count, f);
+    if (fclose(f) != 0) {
+        perror(argv[3]);
+        return EXIT_FAILURE;
+    }
+
+    printf("ovlreloc: %s: %ld bytes, %ld addresses relocated (%ld bytes of table)\n", argv[1], size - HEADER_SIZE, patches, count + 2);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,524 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * HOST TOOL: OVERLAY AREA SIZER                                            *
+ ****************************************************************************/
+
+// This program is executed on the host (not on the retrocomputer) during
+// the build. It sizes the overlay area (that is, each of its slots) after
+// the modules, in two steps:
+//
+//   - "measure": it writes a copy of the linker configuration where the
+//     overlay area is large enough (and placed high enough) for any module,
+//     so that a first link always succeeds and tells the real size of each
+//     OVERLAYn segment into its map file;
+//   - "fit": it reads that map file and it writes a copy of the linker
+//     configuration where the size of each slot is exactly the size of
+//     its largest module, rounded up to the given alignment (__HIMEM__ is
+//     rounded down to it too, so the slots start at aligned addresses). So
+//     the overlay area starts as high as possible, and the resident part 
+//     (and its heap) gets all the rest. It prints the budget of each module,
+//     and it fails with a clear message if the resident part (with its
+//     stack) does not fit below the overlay area.
+//
+// The sizes of the slots are the symbols used as "size" of the memory
+// areas where the OVERLAYn segments are loaded (for example __SLOT1SIZE__
+// or __OVERLAYSIZE__), and they must be defined as "weak" symbols into the
+// SYMBOLS section, as well as __HIMEM__ and __STACKSIZE__. The slots are
+// placed one below the other, starting from __HIMEM__. The "fit" step can
+// also replace the size of the stack (for instance, with the one suggested
+// by a debug build that measures it: see STACKCHECK into the makefile).
+//
+// The "shift" step writes a copy of the linker configuration where the
+// whole overlay area is moved up by the given number of bytes: the modules
+// of a second link with it differ from the real ones only where they hold
+// their own addresses (see tools/ovlreloc.c).
+//
+// Usage: ovlsize measure <linker config> <output config>
+//        ovlsize fit <linker config> <map file> <output config> [<alignment> [<stack size>]]
+//        ovlsize shift <linker config> <output config> <bytes>
+
+/****************************************************************************
+ ** INCLUDE SECTION
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/****************************************************************************
+ ** DEFINITIONS SECTION
+ ****************************************************************************/
+
+// Maximum length of a single line of the input files.
+#define MAX_LINE        512
+
+// Maximum length of a name (of a symbol, of a memory area or a segment).
+#define MAX_NAME        64
+
+// Maximum number of lines of the linker configuration.
+#define MAX_LINES       1024
+
+// Maximum number of symbols, memory areas and segments.
+#define MAX_ITEMS       64
+
+// Values used for the first link: the overlay area ends here, and each
+// slot has this size.
+#define MEASURE_HIMEM   0xF000
+#define MEASURE_SIZE    0x1800
+
+/****************************************************************************
+ ** VARIABLES SECTION
+ ****************************************************************************/
+
+// Lines of the linker configuration.
+static char lines[MAX_LINES][MAX_LINE];
+static int line_count = 0;
+
+// Weak symbols: name, value and line where they are defined.
+static char symbol_names[MAX_ITEMS][MAX_NAME];
+static long symbol_values[MAX_ITEMS];
+static int symbol_lines[MAX_ITEMS];
+static int symbols = 0;
+
+// Memory areas: name and symbol used as size.
+static char area_names[MAX_ITEMS][MAX_NAME];
+static char area_sizes[MAX_ITEMS][MAX_NAME];
+static int areas = 0;
+
+// Segments: name, memory area where they are loaded, size and end address
+// (from the map file).
+static char segment_names[MAX_ITEMS][MAX_NAME];
+static char segment_areas[MAX_ITEMS][MAX_NAME];
+static long segment_sizes[MAX_ITEMS];
+static long segment_ends[MAX_ITEMS];
+static int segments = 0;
+
+// Slots: symbol of the size, and size needed.
+static char slot_names[MAX_ITEMS][MAX_NAME];
+static long slot_sizes[MAX_ITEMS];
+static int slots = 0;
+
+/****************************************************************************
+ ** FUNCTIONS SECTION
+ ****************************************************************************/
+
+/**
+ * This function copies into "result" the identifier found at "text" (after
+ * any space). It returns the position after the identifier.
+ */
+static const char* identifier(const char* text, char* result)
+{
+    int length = 0;
+
+    while (isspace((unsigned char)*text)) {
+        ++text;
+    }
+    while ((isalnum((unsigned char)*text) || *text == '_' || *text == '%') && length < MAX_NAME - 1) {
+        result[length++] = *text++;
+    }
+    result[length] = 0;
+    return text;
+}
+
+/**
+ * This function returns the value of the attribute "attribute" (for
+ * example "size") of the definition "line" into "result". It returns 0 if
+ * the attribute is not present.
+ */
+static int attribute(const char* line, const char* attribute, char* result)
+{
+    const char* p = line;
+    size_t length = strlen(attribute);
+
+    while ((p = strstr(p, attribute)) != NULL) {
+        const char* q = p + length;
+        if ((p == line || !isalnum((unsigned char)p[-1])) && !isalnum((unsigned char)*q) && *q != '_') {
+            while (isspace((unsigned char)*q)) {
+                ++q;
+            }
+            if (*q == '=') {
+                identifier(q + 1, result);
+                return 1;
+            }
+        }
+        p = q;
+    }
+    return 0;
+}
+
+/**
+ * This function parses a number, in decimal or in hexadecimal ("$").
+ */
+static long number(const char* text)
+{
+    while (isspace((unsigned char)*text)) {
+        ++text;
+    }
+    if (*text == '$') {
+        return strtol(text + 1, NULL, 16);
+    }
+    return strtol(text, NULL, 0);
+}
+
+/**
+ * This function returns the index of the weak symbol "name", or -1.
+ */
+static int find_symbol(const char* name)
+{
+    int i;
+
+    for (i = 0; i < symbols; ++i) {
+        if (strcmp(symbol_names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * This function reads the linker configuration "path", and it collects
+ * the weak symbols, the memory areas and the segments. It returns 0 if the
+ * file cannot be read.
+ */
+static int read_config(const char* path)
+{
+    FILE* f = fopen(path, "r");
+    int section = 0;
+
+    if (f == NULL) {
+        perror(path);
+        return 0;
+    }
+
+    while (line_count < MAX_LINES && fgets(lines[line_count], MAX_LINE, f) != NULL) {
+        const char* line = lines[line_count];
+        char name[MAX_NAME];
+        char value[MAX_NAME];
+        const char* p;
+        const char* comment = strchr(line, '#');
+
+        p = identifier(line, name);
+        if (name[0] != 0 && (comment == NULL || comment > p)) {
+            if (strcmp(name, "SYMBOLS") == 0) {
+                section = 'S';
+            } else if (strcmp(name, "MEMORY") == 0) {
+                section = 'M';
+            } else if (strcmp(name, "SEGMENTS") == 0) {
+                section = 'G';
+            } else if (strcmp(name, "FEATURES") == 0) {
+                section = 0;
+            } else if (*p == ':' && section == 'S' && symbols < MAX_ITEMS &&
+                            attribute(line, "type", value) && strcmp(value, "weak") == 0) {
+                strcpy(symbol_names[symbols], name);
+                symbol_values[symbols] = number(strstr(line, "value") ? strchr(strstr(line, "value"), '=') + 1 : "0");
+                symbol_lines[symbols++] = line_count;
+            } else if (*p == ':' && section == 'M' && areas < MAX_ITEMS && attribute(line, "size", value)) {
+                strcpy(area_names[areas], name);
+                strcpy(area_sizes[areas++], value);
+            } else if (*p == ':' && section == 'G' && segments < MAX_ITEMS && attribute(line, "load", value)) {
+                strcpy(segment_names[segments], name);
+                strcpy(segment_areas[segments], value);
+                segment_sizes[segments] = 0;
+                segment_ends[segments++] = 0;
+            }
+        }
+        ++line_count;
+    }
+
+    fclose(f);
+    return 1;
+}
+
+/**
+ * This function collects the slots: the weak symbols used as size of the
+ * memory areas where the OVERLAYn segments are loaded.
+ */
+static void find_slots(void)
+{
+    int i;
+    int j;
+    int k;
+
+    for (i = 0; i < segments; ++i) {
+        if (strncmp(segment_names[i], "OVERLAY", 7) != 0) {
+            continue;
+        }
+        for (j = 0; j < areas; ++j) {
+            if (strcmp(area_names[j], segment_areas[i]) == 0 && find_symbol(area_sizes[j]) >= 0) {
+                for (k = 0; k < slots; ++k) {
+                    if (strcmp(slot_names[k], area_sizes[j]) == 0) {
+                        break;
+                    }
+                }
+                if (k == slots && slots < MAX_ITEMS) {
+                    strcpy(slot_names[slots], area_sizes[j]);
+                    slot_sizes[slots++] = 0;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * This function returns the index of the slot where the segment number
+ * "segment" is loaded, or -1.
+ */
+static int segment_slot(int segment)
+{
+    int j;
+    int k;
+
+    for (j = 0; j < areas; ++j) {
+        if (strcmp(area_names[j], segment_areas[segment]) == 0) {
+            for (k = 0; k < slots; ++k) {
+                if (strcmp(slot_names[k], area_sizes[j]) == 0) {
+                    return k;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+/**
+ * This function changes the value of the weak symbol "name" into the lines
+ * of the linker configuration.
+ */
+static void set_symbol(const char* name, long value)
+{
+    int i = find_symbol(name);
+    char* line;
+    char* start;
+    char* end;
+    char buffer[MAX_LINE];
+
+    if (i < 0) {
+        return;
+    }
+    line = lines[symbol_lines[i]];
+    start = strstr(line, "value");
+    if (start == NULL || (start = strchr(start, '=')) == NULL || (end = strchr(start, ';')) == NULL) {
+        return;
+    }
+    snprintf(buffer, sizeof(buffer), "%.*s= $%04lX; # set by ovlsize\n", (int)(start - line), line, value);
+    strcpy(line, buffer);
+    symbol_values[i] = value;
+}
+
+/**
+ * This function writes the lines of the linker configuration into "path".
+ * It returns 0 if the file cannot be written.
+ */
+static int write_config(const char* path)
+{
+    FILE* f = fopen(path, "w");
+    int i;
+
+    if (f == NULL) {
+        perror(path);
+        return 0;
+    }
+    for (i = 0; i < line_count; ++i) {
+        fputs(lines[i], f);
+    }
+    if (fclose(f) != 0) {
+        perror(path);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * This function reads the "Segment list" of the map file "path": the size
+ * and the end address of each segment. It returns 0 if the file cannot be
+ * read.
+ */
+static int read_map(const char* path)
+{
+    char line[MAX_LINE];
+    FILE* f = fopen(path, "r");
+    int listing = 0;
+
+    if (f == NULL) {
+        perror(path);
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char name[MAX_NAME];
+        unsigned long start;
+        unsigned long end;
+        unsigned long size;
+        int i;
+
+        if (strncmp(line, "Segment list", 12) == 0) {
+            listing = 1;
+            continue;
+        }
+        if (!listing) {
+            continue;
+        }
+        if (strncmp(line, "Exports list", 12) == 0) {
+            break;
+        }
+        if (sscanf(line, "%63s %lx %lx %lx", name, &start, &end, &size) != 4) {
+            continue;
+        }
+        for (i = 0; i < segments; ++i) {
+            if (strcmp(segment_names[i], name) == 0) {
+                segment_sizes[i] = (long)size;
+                segment_ends[i] = size ? (long)end + 1 : 0;
+            }
+        }
+    }
+
+    fclose(f);
+    return 1;
+}
+
+/**
+ * This function writes the configuration for the first link.
+ */
+static int measure(const char* output)
+{
+    int i;
+
+    set_symbol("__HIMEM__", MEASURE_HIMEM);
+    for (i = 0; i < slots; ++i) {
+        set_symbol(slot_names[i], MEASURE_SIZE);
+    }
+    return write_config(output);
+}
+
+/**
+ * This function writes the configuration with the slots sized after the
+ * modules, and it prints the budget of each module. If "stack_size" is not
+ * zero, it replaces the size of the stack.
+ */
+static int fit(const char* map, const char* output, long alignment, long stack_size)
+{
+    long himem;
+    long stack;
+    long start;
+    long before = 0;
+    long after = 0;
+    long resident = 0;
+    int i;
+
+    if (find_symbol("__HIMEM__") < 0 || find_symbol("__STACKSIZE__") < 0) {
+        fprintf(stderr, "ovlsize: __HIMEM__ and __STACKSIZE__ must be weak symbols\n");
+        return 0;
+    }
+    if (stack_size > 0) {
+        set_symbol("__STACKSIZE__", stack_size);
+    }
+    himem = symbol_values[find_symbol("__HIMEM__")] / alignment * alignment;
+    stack = symbol_values[find_symbol("__STACKSIZE__")];
+    set_symbol("__HIMEM__", himem);
+
+    if (!read_map(map)) {
+        return 0;
+    }
+
+    // Each slot must be as large as its largest module.
+    for (i = 0; i < segments; ++i) {
+        int slot = segment_slot(i);
+        if (strncmp(segment_names[i], "OVERLAY", 7) == 0 && slot >= 0 && segment_sizes[i] > slot_sizes[slot]) {
+            slot_sizes[slot] = segment_sizes[i];
+        }
+    }
+    for (i = 0; i < slots; ++i) {
+        slot_sizes[i] = (slot_sizes[i] + alignment - 1) / alignment * alignment;
+        if (slot_sizes[i] == 0) {
+            slot_sizes[i] = alignment;
+        }
+        before += symbol_values[find_symbol(slot_names[i])];
+        after += slot_sizes[i];
+        set_symbol(slot_names[i], slot_sizes[i]);
+    }
+
+    // The resident part ends with the last segment that is not into the
+    // overlay area (and that is not in zero page).
+    for (i = 0; i < segments; ++i) {
+        if (segment_slot(i) < 0 && segment_ends[i] > 0x0200 && segment_ends[i] > resident &&
+                    strcmp(segment_areas[i], "LOADADDR") != 0 && strncmp(segment_areas[i], "OVL", 3) != 0) {
+            resident = segment_ends[i];
+        }
+    }
+    start = himem - after;
+
+    printf("ovlsize: %-10s %-16s %6s %6s %8s\n", "module", "slot", "used", "size", "headroom");
+    for (i = 0; i < segments; ++i) {
+        int slot = segment_slot(i);
+        if (strncmp(segment_names[i], "OVERLAY", 7) == 0 && slot >= 0 && segment_sizes[i] > 0) {
+            printf("ovlsize: %-10s %-16s %6ld %6ld %8ld\n", segment_names[i], slot_names[slot],
+                        segment_sizes[i], slot_sizes[slot], slot_sizes[slot] - segment_sizes[i]);
+        }
+    }
+    printf("ovlsize: overlay area $%04lX-$%04lX (%ld bytes, %ld before); resident part and stack up to $%04lX (%ld bytes free)\n",
+                start, himem - 1, after, before, resident + stack, start - resident - stack);
+
+    if (resident + stack > start) {
+        fprintf(stderr, "ovlsize: the resident part (up to $%04lX) and its stack (%ld bytes) overflow into the overlay area "
+                        "(from $%04lX) by %ld bytes: make the modules or the resident part smaller\n",
+                        resident, stack, start, resident + stack - start);
+        return 0;
+    }
+
+    return write_config(output);
+}
+
+/**
+ * This function writes the configuration with the overlay area moved up by
+ * "bytes" bytes.
+ */
+static int shift(const char* output, long bytes)
+{
+    int i = find_symbol("__HIMEM__");
+
+    if (i < 0) {
+        fprintf(stderr, "ovlsize: __HIMEM__ must be a weak symbol\n");
+        return 0;
+    }
+    set_symbol("__HIMEM__", symbol_values[i] + bytes);
+    return write_config(output);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc >= 4 && strcmp(argv[1], "measure") == 0) {
+        if (!read_config(argv[2])) {
+            return EXIT_FAILURE;
+        }
+        find_slots();
+        return measure(argv[3]) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (argc >= 5 && strcmp(argv[1], "fit") == 0) {
+        long alignment = argc >= 6 ? strtol(argv[5], NULL, 0) : 1;
+        long stack_size = argc >= 7 ? strtol(argv[6], NULL, 0) : 0;
+        if (alignment <= 0) {
+            alignment = 1;
+        }
+        if (!read_config(argv[2])) {
+            return EXIT_FAILURE;
+        }
+        find_slots();
+        return fit(argv[3], argv[4], alignment, stack_size) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (argc >= 5 && strcmp(argv[1], "shift") == 0) {
+        if (!read_config(argv[2])) {
+            return EXIT_FAILURE;
+        }
+        return shift(argv[3], strtol(argv[4], NULL, 0)) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "usage: %s measure <linker config> <output config>\n", argv[0]);
+    fprintf(stderr, "       %s fit <linker config> <map file> <output config> [<alignment> [<stack size>]]\n", argv[0]);
+    fprintf(stderr, "       %s shift <linker config> <output config> <bytes>\n", argv[0]);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,241 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * HOST TOOL: CALL-THROUGH STUBS GENERATOR                                  *
+ ****************************************************************************/
+
+// This program is executed on the host (not on the retrocomputer) during
+// the build. It reads the include file of the program and, for each group
+// of functions annotated as:
+//
+//      // OVERLAYED FUNCTIONS (MODULE n)
+//      void function(void);
+//      ...
+//
+// it emits a small resident "trampoline" (in ca65 syntax) with the same
+// name of the function. The trampoline asks the overlay manager to make
+// the module "n" resident and then jumps to the real entry point, that is
+// the function defined with the OVERLAYED() macro into the module itself.
+// The function returns through the overlay manager (see ovlenter into 
+// ovlcall.s), that makes present the module of the caller again: so the 
+// functions of a module can call the ones of any other module.
+//
+// When the modules are relocatable (__RELOCATE__, see RELOCATE into the
+// makefile), the address of each function is put into the header of its
+// module instead, and the trampoline jumps to the address found there,
+// wherever the module has been loaded (see ovljump into ovlcall.s). So the
+// stubs must be linked before the modules.
+//
+// With the "-c" option, the trampolines are written in C for the native
+// build (see the host directory): each of them also asks the shim to check
+// that the module is still there when the function returns. Only functions
+// without parameters and result can be called through them.
+//
+// Usage: ovlstub [-c] <include file> <assembly or C file>
+
+/****************************************************************************
+ ** INCLUDE SECTION
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/****************************************************************************
+ ** DEFINITIONS SECTION
+ ****************************************************************************/
+
+// Maximum length of a single line of the include file.
+#define MAX_LINE        512
+
+// Maximum length of the name of a function.
+#define MAX_NAME        64
+
+// Annotation that starts a group of overlayed functions.
+#define ANNOTATION      "OVERLAYED FUNCTIONS (MODULE "
+
+/****************************************************************************
+ ** FUNCTIONS SECTION
+ ****************************************************************************/
+
+/**
+ * This function extracts the name of the function declared by the
+ * prototype "line" into "name". It returns 0 if the line is not a
+ * prototype.
+ */
+static int prototype_name(const char* line, char* name)
+{
+    const char* parenthesis = strchr(line, '(');
+    const char* end;
+    const char* start;
+
+    if (parenthesis == NULL || strchr(line, ';') == NULL) {
+        return 0;
+    }
+
+    end = parenthesis;
+    while (end > line && isspace((unsigned char)end[-1])) {
+        --end;
+    }
+    start = end;
+    while (start > line && (isalnum((unsigned char)start[-1]) || start[-1] == '_')) {
+        --start;
+    }
+    if (start == end || end - start >= MAX_NAME) {
+        return 0;
+    }
+
+    memcpy(name, start, end - start);
+    name[end - start] = 0;
+    return 1;
+}
+
+/**
+ * This function writes the trampoline for the function "name", that lives
+ * into the module "module" (and it is the function number "entry" of the
+ * header of the module).
+ */
+static void write_stub(FILE* out, const char* name, int module, int entry)
+{
+    fprintf(out, "\n; %s() lives into the module %d\n\n", name, module);
+    fprintf(out, "        .export     _%s\n", name);
+    fprintf(out, "        .import     _%s_overlayed\n\n", name);
+    fprintf(out, ".ifdef __RELOCATE__\n\n");
+    fprintf(out, ".segment \"OVERLAY%d\"\n\n", module);
+    fprintf(out, "        .word       _%s_overlayed\n\n", name);
+    fprintf(out, ".segment \"CODE\"\n\n");
+    fprintf(out, "_%s:\n", name);
+    fprintf(out, "        ldy     #%d\n", entry);
+    fprintf(out, "        sty     ovlindex\n");
+    fprintf(out, "        ldy     #%d\n", module);
+    fprintf(out, "        jmp     ovljump\n\n");
+    fprintf(out, ".else\n\n");
+    fprintf(out, "_%s:\n", name);
+    fprintf(out, "        ldy     #%d\n", module);
+    fprintf(out, "        jsr     ovlenter\n");
+    fprintf(out, "        jmp     _%s_overlayed\n\n", name);
+    fprintf(out, ".endif\n");
+}
+
+/**
+ * This function writes the trampoline in C for the function "name", that
+ * lives into the module "module".
+ */
+static void write_c_stub(FILE* out, const char* name, int module)
+{
+    fprintf(out, "\n// %s() lives into the module %d\n\n", name, module);
+    fprintf(out, "void OVERLAYED(%s)(void);\n\n", name);
+    fprintf(out, "void %s(void)\n{\n", name);
+    fprintf(out, "    if (overlay_call(%d)) {\n", module);
+    fprintf(out, "        OVERLAYED(%s)();\n", name);
+    fprintf(out, "        host_check(%d, \"%s\");\n", module, name);
+    fprintf(out, "        overlay_return();\n");
+    fprintf(out, "    }\n}\n");
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* in;
+    FILE* out;
+    char line[MAX_LINE];
+    char name[MAX_NAME];
+    int entries[256] = { 0 };
+    int module = 0;
+    int stubs = 0;
+    int lineno = 0;
+    int c_stubs = 0;
+
+    if (argc == 4 && strcmp(argv[1], "-c") == 0) {
+        c_stubs = 1;
+        argv[1] = argv[0];
+        ++argv;
+        --argc;
+    }
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s [-c] <include file> <assembly or C file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    in = fopen(argv[1], "r");
+    if (in == NULL) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    out = fopen(argv[2], "w");
+    if (out == NULL) {
+        perror(argv[2]);
+        fclose(in);
+        return EXIT_FAILURE;
+    }
+
+    if (c_stubs) {
+        fprintf(out, "// Generated by ovlstub from %s: do not edit.\n\n", argv[1]);
+        fprintf(out, "#include \"main.h\"\n");
+    } else {
+        fprintf(out, "; Generated by ovlstub from %s: do not edit.\n\n", argv[1]);
+        fprintf(out, "        .import     ovlenter\n");
+        fprintf(out, ".ifdef __RELOCATE__\n");
+        fprintf(out, "        .import     ovljump, ovlindex\n");
+        fprintf(out, ".endif\n\n");
+        fprintf(out, ".segment \"CODE\"\n");
+    }
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        char* annotation = strstr(line, ANNOTATION);
+        char* text = line;
+
+        ++lineno;
+
+        while (isspace((unsigned char)*text)) {
+            ++text;
+        }
+
+        // A new group starts with the annotation, while any other comment
+        // or an empty line ends the current one.
+        if (annotation != NULL) {
+            module = atoi(annotation + strlen(ANNOTATION));
+            if (module < 1 || module > 255) {
+                fprintf(stderr, "%s:%d: invalid module number\n", argv[1], lineno);
+                fclose(in);
+                fclose(out);
+                remove(argv[2]);
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+        if (*text == 0 || *text == '/' || *text == '#') {
+            module = 0;
+            continue;
+        }
+
+        if (module != 0 && prototype_name(text, name)) {
+            if (!c_stubs) {
+                write_stub(out, name, module, entries[module]++);
+            } else if (strncmp(text, "void ", 5) == 0 && strstr(text, "(void)") != NULL) {
+                write_c_stub(out, name, module);
+            } else {
+                fprintf(stderr, "%s:%d: %s() cannot be called through a C trampoline\n", argv[1], lineno, name);
+                fclose(in);
+                fclose(out);
+                remove(argv[2]);
+                return EXIT_FAILURE;
+            }
+            ++stubs;
+        }
+    }
+
+    fclose(in);
+
+    if (fclose(out) != 0) {
+        perror(argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    printf("ovlstub: %d stubs written to %s\n", stubs, argv[2]);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,519 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * HOST TOOL: TAPE IMAGE                                                    *
+ ****************************************************************************/
+
+// This program is executed on the host (not on the retrocomputer) during
+// the build of the "c64tap" target. It writes a tape image (TAP format, as
+// used by VICE: x64sc -1 <image>) with:
+//
+//   - the resident program, in the format of the KERNAL routines, so that
+//     it is loaded by LOAD (header and data, each of them written twice);
+//   - the overlay modules, in the format of the turbo loader of tape.s, one
+//     after the other as they are expected to be loaded by a session: the
+//     sequence of loads is the same used to place the modules on the disk
+//     (see tools/ovllayout.c), so a module loaded more than once is written
+//     more than once. Then a copy of each module follows (for the loads
+//     that were not expected), and a block that marks the end of the tape.
+//
+// A turbo block starts with a pilot (TURBO_PILOT bytes), and a sync byte.
+// Then there are the number of the module, the address where it is loaded
+// (2 bytes) and its size (2 bytes), the module and a checksum (the XOR of
+// the bytes of the module). Each bit is a pulse, shorter for 0 and longer
+// for 1, the most significant bit first. The loader skips the blocks of
+// the modules that are not wanted, so the tape is read forward only, and
+// a session that follows the sequence reads it once.
+//
+// At the end, it prints how long the sequence of loads would take to be
+// read from the tape, with the turbo loader and with the KERNAL routines.
+//
+// Usage: ovltape <sequence> <tape image> <program> <name of the program> <name>=<module> [...]
+//
+// The modules are numbered as given, starting from 1.
+
+/****************************************************************************
+ ** INCLUDE SECTION
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/****************************************************************************
+ ** DEFINITIONS SECTION
+ ****************************************************************************/
+
+// Maximum size of a file (the whole address space), and of the image.
+#define MAX_FILE            65536
+#define MAX_TAPE            (8L * 1024 * 1024)
+
+// Maximum length of a name, number of modules and of loads into the
+// sequence.
+#define MAX_NAME            64
+#define MAX_MODULES         32
+#define MAX_LOADS           1024
+
+// Size of the load address, at the beginning of a file.
+#define LOAD_SIZE           2
+
+// TAP format: signature, version and size of the header. A pulse is
+// written as its length in cycles divided by 8; a 0 is followed by the
+// length of a pause, in cycles (3 bytes).
+#define TAP_SIGNATURE       "C64-TAPE-RAW"
+#define TAP_VERSION         1
+#define TAP_HEADER          20
+
+// Cycles of a second (PAL).
+#define CYCLES              985248L
+
+// Format of the KERNAL routines: the three pulses (short, medium, long),
+// the pilots of the first and of the second copy of the header and of the
+// data, and the trailer. The header has a fixed size, and it tells the
+// type of file (1 = program, loaded at the start of BASIC).
+#define KERNAL_SHORT        0x30
+#define KERNAL_MEDIUM       0x42
+#define KERNAL_LONG         0x56
+#define KERNAL_HEADER_PILOT 0x6a00
+#define KERNAL_DATA_PILOT   0x1a00
+#define KERNAL_REPEAT_PILOT 0x4f
+#define KERNAL_TRAILER      0x4e
+#define KERNAL_HEADER       192
+#define KERNAL_PROGRAM      1
+#define KERNAL_NAME         16
+
+// Format of the turbo loader (see tape.s): the pulses of a 0 and of a 1,
+// the pilot byte (repeated TURBO_PILOT times, TURBO_LEADER times before the
+// first block, while the motor takes speed) and the sync byte. The end of
+// the tape is a block of TURBO_END, without any module.
+#define TURBO_ZERO          0x1a
+#define TURBO_ONE           0x28
+#define TURBO_PILOT_BYTE    0x02
+#define TURBO_SYNC          0x09
+#define TURBO_PILOT         512
+#define TURBO_LEADER        2048
+#define TURBO_TRAILER       8
+#define TURBO_END           0
+
+// Pause between the program and the modules, in cycles.
+#define PAUSE               CYCLES
+
+// A module: its name into the sequence, its load address and its content.
+typedef struct tape_module {
+    char name[MAX_NAME];
+    unsigned int address;
+    long size;
+    unsigned char* data;
+} tape_module;
+
+/****************************************************************************
+ ** VARIABLES SECTION
+ ****************************************************************************/
+
+static unsigned char tape[MAX_TAPE];
+static long tape_size = TAP_HEADER;
+static int tape_full = 0;
+
+// Cycles taken by the pulses written so far. When "measure" is set, the
+// pulses are not written, but only counted.
+static unsigned long cycles = 0;
+static int measure = 0;
+
+static unsigned char program[MAX_FILE + LOAD_SIZE];
+
+// Sequence of loads.
+static char loads[MAX_LOADS][MAX_NAME];
+static int load_count = 0;
+
+// Modules to write.
+static tape_module modules[MAX_MODULES];
+static int module_count = 0;
+
+/****************************************************************************
+ ** FUNCTIONS SECTION
+ ****************************************************************************/
+
+/**
+ * This function reads the file "path" into "buffer". It returns its size,
+ * or -1 if any error occours.
+ */
+static long read_file(const char* path, unsigned char* buffer, long size)
+{
+    FILE* f = fopen(path, "rb");
+    long result;
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    result = (long)fread(buffer, 1, (size_t)size, f);
+    fclose(f);
+    return result;
+}
+
+/**
+ * This function reads the sequence of loads from the file "name". It
+ * returns 0 if any error occours.
+ */
+static int read_sequence(const char* name)
+{
+    FILE* f = fopen(name, "r");
+    int comment = 0;
+    int length = 0;
+    int c;
+
+    if (f == NULL) {
+        perror(name);
+        return 0;
+    }
+    do {
+        c = fgetc(f);
+        if (c == '#') {
+            comment = 1;
+        } else if (c == '\n') {
+            comment = 0;
+        }
+        if (c == EOF || comment || isspace(c)) {
+            if (length > 0 && load_count < MAX_LOADS) {
+                loads[load_count++][length] = 0;
+            }
+            length = 0;
+        } else if (length < MAX_NAME - 1 && load_count < MAX_LOADS) {
+            loads[load_count][length++] = (char)c;
+        }
+    } while (c != EOF);
+    fclose(f);
+    return 1;
+}
+
+/**
+ * This function reads the "<name>=<module>" arguments into the modules to
+ * write. It returns 0 if any error occours.
+ */
+static int read_modules(int count, char* arguments[])
+{
+    static unsigned char buffer[MAX_FILE + LOAD_SIZE];
+    int i;
+
+    for (i = 0; i < count; ++i) {
+        char* path = strchr(arguments[i], '=');
+        tape_module* module = &modules[module_count];
+        long size;
+
+        if (path == NULL || path == arguments[i] || path - arguments[i] >= MAX_NAME || module_count >= MAX_MODULES) {
+            fprintf(stderr, "ovltape: invalid module \"%s\"\n", arguments[i]);
+            return 0;
+        }
+        size = read_file(path + 1, buffer, sizeof(buffer));
+        if (size < 0) {
+            return 0;
+        }
+        if (size <= LOAD_SIZE) {
+            fprintf(stderr, "%s: empty module\n", path + 1);
+            return 0;
+        }
+
+        memcpy(module->name, arguments[i], (size_t)(path - arguments[i]));
+        module->name[path - arguments[i]] = 0;
+        module->address = buffer[0] | (buffer[1] << 8);
+        module->size = size - LOAD_SIZE;
+        module->data = malloc((size_t)module->size);
+        if (module->data == NULL) {
+            fprintf(stderr, "ovltape: out of memory\n");
+            return 0;
+        }
+        memcpy(module->data, buffer + LOAD_SIZE, (size_t)module->size);
+        ++module_count;
+    }
+    return 1;
+}
+
+/**
+ * This function returns the index of the module named "name", or -1 if
+ * there is no such module.
+ */
+static int find_module(const char* name)
+{
+    int i;
+
+    for (i = 0; i < module_count; ++i) {
+        if (strcmp(modules[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * This function writes a pulse "length" long (in cycles divided by 8).
+ */
+static void pulse(unsigned char length)
+{
+    cycles += length * 8UL;
+    if (measure) {
+        return;
+    }
+    if (tape_size >= MAX_TAPE) {
+        tape_full = 1;
+        return;
+    }
+    tape[tape_size++] = length;
+}
+
+/**
+ * This function writes a pause "length" cycles long.
+ */
+static void silence(unsigned long length)
+{
+    cycles += length;
+    if (measure) {
+        return;
+    }
+    if (tape_size + 4 > MAX_TAPE) {
+        tape_full = 1;
+        return;
+    }
+    tape[tape_size++] = 0;
+    tape[tape_size++] = (unsigned char)(length & 0xff);
+    tape[tape_size++] = (unsigned char)((length >> 8) & 0xff);
+    tape[tape_size++] = (unsigned char)((length >> 16) & 0xff);
+}
+
+/**
+ * This function writes the byte "value" in the format of the KERNAL: a
+ * marker, the bits (the least significant first) and the parity bit (so
+ * that the number of 1 is odd). Each bit is made by two pulses.
+ */
+static void kernal_byte(unsigned char value)
+{
+    int parity = 1;
+    int i;
+
+    pulse(KERNAL_LONG);
+    pulse(KERNAL_MEDIUM);
+    for (i = 0; i <= 8; ++i) {
+        int bit = (i < 8) ? (value >> i) & 1 : parity;
+        if (bit) {
+            pulse(KERNAL_MEDIUM);
+            pulse(KERNAL_SHORT);
+        } else {
+            pulse(KERNAL_SHORT);
+            pulse(KERNAL_MEDIUM);
+        }
+        parity ^= bit;
+    }
+}
+
+/**
+ * This function writes the "size" bytes of "data" as a block of the KERNAL,
+ * after a pilot "pilot" pulses long. The block is written twice: the sync
+ * bytes tell which copy it is. Each copy ends with the checksum (the XOR
+ * of the bytes) and with a marker.
+ */
+static void kernal_block(const unsigned char* data, long size, int pilot)
+{
+    int copy;
+    int i;
+
+    for (copy = 0; copy < 2; ++copy) {
+        unsigned char checksum = 0;
+        for (i = 0; i < (copy ? KERNAL_REPEAT_PILOT : pilot); ++i) {
+            pulse(KERNAL_SHORT);
+        }
+        for (i = 9; i >= 1; --i) {
+            kernal_byte((unsigned char)((copy ? 0x00 : 0x80) | i));
+        }
+        for (i = 0; i < size; ++i) {
+            kernal_byte(data[i]);
+            checksum ^= data[i];
+        }
+        kernal_byte(checksum);
+        pulse(KERNAL_LONG);
+        pulse(KERNAL_SHORT);
+    }
+    for (i = 0; i < KERNAL_TRAILER; ++i) {
+        pulse(KERNAL_SHORT);
+    }
+}
+
+/**
+ * This function writes the file "name", of "size" bytes, that is loaded at
+ * "address", in the format of the KERNAL: the header, and then the data.
+ */
+static void kernal_file(const char* name, unsigned int address, const unsigned char* data, long size)
+{
+    unsigned char header[KERNAL_HEADER];
+    unsigned int end = (unsigned int)(address + size);
+    size_t i;
+
+    memset(header, ' ', sizeof(header));
+    header[0] = KERNAL_PROGRAM;
+    header[1] = (unsigned char)(address & 0xff);
+    header[2] = (unsigned char)(address >> 8);
+    header[3] = (unsigned char)(end & 0xff);
+    header[4] = (unsigned char)(end >> 8);
+    for (i = 0; i < KERNAL_NAME && name[i] != 0; ++i) {
+        header[5 + i] = (unsigned char)toupper((unsigned char)name[i]);
+    }
+    kernal_block(header, sizeof(header), KERNAL_HEADER_PILOT);
+    kernal_block(data, size, KERNAL_DATA_PILOT);
+}
+
+/**
+ * This function writes the byte "value" in the format of the turbo loader.
+ */
+static void turbo_byte(unsigned char value)
+{
+    int i;
+
+    for (i = 7; i >= 0; --i) {
+        pulse(((value >> i) & 1) ? TURBO_ONE : TURBO_ZERO);
+    }
+}
+
+/**
+ * This function writes the module number "number" (TURBO_END if none) in
+ * the format of the turbo loader, after a pilot of "pilot" bytes.
+ */
+static void turbo_block(int number, int pilot)
+{
+    const tape_module* module = (number != TURBO_END) ? &modules[number - 1] : NULL;
+    unsigned char checksum = 0;
+    long i;
+
+    for (i = 0; i < pilot; ++i) {
+        turbo_byte(TURBO_PILOT_BYTE);
+    }
+    turbo_byte(TURBO_SYNC);
+    turbo_byte((unsigned char)number);
+    turbo_byte(module ? (unsigned char)(module->address & 0xff) : 0);
+    turbo_byte(module ? (unsigned char)(module->address >> 8) : 0);
+    turbo_byte(module ? (unsigned char)(module->size & 0xff) : 0);
+    turbo_byte(module ? (unsigned char)(module->size >> 8) : 0);
+    if (module) {
+        for (i = 0; i < module->size; ++i) {
+            turbo_byte(module->data[i]);
+            checksum ^= module->data[i];
+        }
+        turbo_byte(checksum);
+    }
+    for (i = 0; i < TURBO_TRAILER; ++i) {
+        turbo_byte(0);
+    }
+}
+
+/**
+ * This function prints how long the sequence of loads takes to be read,
+ * as written (each module read while the tape goes forward, skipping the
+ * ones not wanted) and as it would take with the KERNAL routines (reading
+ * each module only, as if the tape were always at the right place).
+ */
+static void estimate(int blocks, const int* sequence)
+{
+    unsigned long turbo;
+    unsigned long kernal;
+    int i;
+
+    measure = 1;
+    cycles = 0;
+    for (i = 0; i < blocks; ++i) {
+        turbo_block(sequence[i], i == 0 ? TURBO_LEADER : TURBO_PILOT);
+    }
+    turbo = cycles;
+
+    cycles = 0;
+    for (i = 0; i < load_count; ++i) {
+        int index = find_module(loads[i]);
+        if (index >= 0) {
+            kernal_file(modules[index].name, modules[index].address, modules[index].data, modules[index].size);
+        }
+    }
+    kernal = cycles;
+    measure = 0;
+
+    printf("ovltape: the sequence takes %.1f s (%.1f s with the KERNAL routines)\n",
+                (double)turbo / CYCLES, (double)kernal / CYCLES);
+}
+
+int main(int argc, char* argv[])
+{
+    static int sequence[MAX_LOADS + MAX_MODULES + 1];
+    long program_size;
+    long data_size;
+    int blocks = 0;
+    int expected;
+    int i;
+    FILE* f;
+
+    if (argc < 6) {
+        fprintf(stderr, "usage: %s <sequence> <tape image> <program> <name of the program> <name>=<module> [...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (!read_sequence(argv[1]) || !read_modules(argc - 5, argv + 5)) {
+        return EXIT_FAILURE;
+    }
+    program_size = read_file(argv[3], program, sizeof(program));
+    if (program_size < 0) {
+        return EXIT_FAILURE;
+    }
+    if (program_size <= LOAD_SIZE) {
+        fprintf(stderr, "%s: empty program\n", argv[3]);
+        return EXIT_FAILURE;
+    }
+
+    // The modules of the sequence (the names that are not modules are
+    // ignored), then all the modules, and the end of the tape.
+    for (i = 0; i < load_count; ++i) {
+        int index = find_module(loads[i]);
+        if (index >= 0) {
+            sequence[blocks++] = index + 1;
+        }
+    }
+    expected = blocks;
+    for (i = 0; i < module_count; ++i) {
+        sequence[blocks++] = i + 1;
+    }
+    sequence[blocks++] = TURBO_END;
+
+    kernal_file(argv[4], program[0] | (program[1] << 8), program + LOAD_SIZE, program_size - LOAD_SIZE);
+    silence(PAUSE);
+    for (i = 0; i < blocks; ++i) {
+        turbo_block(sequence[i], i == 0 ? TURBO_LEADER : TURBO_PILOT);
+    }
+    if (tape_full) {
+        fprintf(stderr, "%s: the tape is full\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    data_size = tape_size - TAP_HEADER;
+    memcpy(tape, TAP_SIGNATURE, strlen(TAP_SIGNATURE));
+    tape[12] = TAP_VERSION;
+    tape[16] = (unsigned char)(data_size & 0xff);
+    tape[17] = (unsigned char)((data_size >> 8) & 0xff);
+    tape[18] = (unsigned char)((data_size >> 16) & 0xff);
+    tape[19] = (unsigned char)((data_size >> 24) & 0xff);
+
+    f = fopen(argv[2], "wb");
+    if (f == NULL) {
+        perror(argv[2]);
+        return EXIT_FAILURE;
+    }
+    fwrite(tape, 1, (size_t)tape_size, f);
+    if (fclose(f) != 0) {
+        perror(argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    printf("ovltape: %s: program of %ld bytes, %d modules, %d blocks (%d of the sequence), %.1f s\n",
+                argv[2], program_size - LOAD_SIZE, module_count, blocks, expected, (double)cycles / CYCLES);
+    estimate(expected, sequence);
+
+    for (i = 0; i < module_count; ++i) {
+        free(modules[i].data);
+    }
+    return EXIT_SUCCESS;
+}
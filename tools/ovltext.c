@@ -0,0 +1,802 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * HOST TOOL: VERSES COMPRESSOR                                             *
+ ****************************************************************************/
+
+// This program is executed on the host (not on the retrocomputer) during
+// the build. It reads the sources given on the command line, it takes all
+// the strings passed to write_verse() and it compresses them with a single
+// dictionary, shared by all the modules and languages. Then it writes, into
+// the output directory:
+//
+//   - a copy of each source, where each string has been replaced by an
+//     array with the compressed text (so it stays into the segment of the
+//     module, exactly as the string did);
+//   - "dictionary.c", with the dictionary (that is resident, see main.h).
+//
+// If a source has a block like this one:
+//
+//      if (language == 0) {
+//          write_verse("...");
+//          press_any_key();
+//          ...
+//      } else {
+//          ...
+//      }
+//
+// the text of each language is moved into a module of its own (for
+// example, "part1.it.c" and "part1.en.c"), starting from the module number
+// given on the command line: two modules for each source, in the same
+// order. Into the copy of the source, the block is replaced by a call to
+// write_text(), that loads only the module of the chosen language. Into
+// the block, only write_verse() with a string and press_any_key() can be
+// used.
+//
+// The compressed text is already in PETSCII, since the compiler does not
+// translate numbers. Each byte is:
+//
+//   - $00: end of the verse;
+//   - $80...$BC: the entry (byte - $80) of the dictionary;
+//   - $BD: end of the text of a language (in place of a verse);
+//   - $BE: wait for a key (in place of a verse);
+//   - $BF: the next byte is a character (for characters from $80 to $BF);
+//   - otherwise: a character.
+//
+// The dictionary is made by the substrings that save more bytes, chosen
+// one by one. Its size is limited to 255 bytes, so that the position of
+// each entry fits into a byte.
+//
+// With the "-a" option, the text is kept in ASCII, for the native build
+// (see the host directory).
+//
+// Usage: ovltext [-a] <output directory> <first text module> <source> [<source> ...]
+
+/****************************************************************************
+ ** INCLUDE SECTION
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/****************************************************************************
+ ** DEFINITIONS SECTION
+ ****************************************************************************/
+
+// Name of the function whose strings are compressed.
+#define FUNCTION            "write_verse("
+
+// Beginning of the block with the text of each language, and the other
+// function that can be called into it.
+#define LANGUAGE_BLOCK      "if (language == 0)"
+#define PAUSE               "press_any_key();"
+
+// Languages, in the order of the "language" variable (see main.c).
+#define LANGUAGES           2
+static const char* languages[LANGUAGES] = { "it", "en" };
+
+// Tokens of the compressed text (see TEXT_TOKEN into main.h).
+#define TOKEN_FIRST         0x80
+#define TOKEN_END           0xbd
+#define TOKEN_PAUSE         0xbe
+#define TOKEN_ESCAPE        0xbf
+#define MAX_ENTRIES         (TOKEN_END - TOKEN_FIRST)
+
+// Maximum size of the dictionary, and length of an entry.
+#define MAX_DICTIONARY      255
+#define MIN_LENGTH          2
+#define MAX_LENGTH          16
+
+// Maximum length of a verse (see TEXT_LINE into main.h).
+#define MAX_VERSE           80
+
+// Maximum number of sources, of strings and size of a source.
+#define MAX_SOURCES         16
+#define MAX_STRINGS         512
+#define MAX_SOURCE          65536
+#define MAX_STRING          256
+
+// Into the strings being compressed, a symbol is a character (0...255) or
+// an entry of the dictionary (TOKEN + entry).
+#define TOKEN               0x100
+
+// A string passed to write_verse(): where it is into the source (from the
+// opening to the closing quote, included), its symbols and its length. The
+// language is -1 if the string is left into the source, and "pause" tells
+// a press_any_key() into the block of a language (without any symbol).
+typedef struct verse {
+    int source;
+    int language;
+    int pause;
+    long start;
+    long end;
+    int symbols[MAX_STRING];
+    int length;
+} verse;
+
+// A candidate entry of the dictionary: the position of a substring into
+// the strings.
+typedef struct candidate {
+    int verse;
+    int start;
+    int length;
+} candidate;
+
+/****************************************************************************
+ ** VARIABLES SECTION
+ ****************************************************************************/
+
+static char* sources[MAX_SOURCES];
+static long source_sizes[MAX_SOURCES];
+static int source_count = 0;
+
+// Where the block with the languages starts and ends into each source (-1
+// if there is none), and the number of its first text module.
+static long block_starts[MAX_SOURCES];
+static long block_ends[MAX_SOURCES];
+static int block_modules[MAX_SOURCES];
+static int next_module;
+
+// The text is kept in ASCII (-a option).
+static int ascii_text = 0;
+
+static verse verses[MAX_STRINGS];
+static int verse_count = 0;
+
+static unsigned char dictionary[MAX_DICTIONARY];
+static int offsets[MAX_ENTRIES + 1];
+static int entry_count = 0;
+
+static candidate candidates[MAX_STRINGS * MAX_STRING * (MAX_LENGTH - MIN_LENGTH + 1) / 8];
+static long candidate_count;
+
+/****************************************************************************
+ ** PARSING FUNCTIONS
+ ****************************************************************************/
+
+/**
+ * This function converts the ASCII character "c" into PETSCII, as the
+ * compiler does: lowercase and uppercase letters are swapped, and the
+ * new line becomes a carriage return. Other characters are kept (all of
+ * them, with the -a option).
+ */
+static int petscii(int c)
+{
+    if (ascii_text) {
+        return c;
+    } else if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 0x41;
+    } else if (c >= 'A' && c <= 'Z') {
+        return c - 'A' + 0xc1;
+    } else if (c == '\n') {
+        return 0x0d;
+    }
+    return c;
+}
+
+/**
+ * This function reads the string that starts (with the quote) at "start"
+ * into the source "source", as a new verse of the language "language".
+ * It returns 0 if the string is not complete.
+ */
+static int read_verse(int source, long start, int language)
+{
+    const char* text = sources[source];
+    verse* v = &verses[verse_count];
+    long i = start + 1;
+
+    v->source = source;
+    v->language = language;
+    v->pause = 0;
+    v->start = start;
+    v->length = 0;
+
+    while (i < source_sizes[source] && text[i] != '"') {
+        int c = (unsigned char)text[i++];
+        if (c == '\\' && i < source_sizes[source]) {
+            c = (unsigned char)text[i++];
+            switch (c) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'x':
+                    c = (int)strtol(text + i, NULL, 16);
+                    while (strchr("0123456789abcdefABCDEF", text[i])) {
+                        ++i;
+                    }
+                    break;
+                default: break;
+            }
+        }
+        if (v->length >= MAX_VERSE) {
+            return 0;
+        }
+        v->symbols[v->length++] = petscii(c);
+    }
+    if (i >= source_sizes[source]) {
+        return 0;
+    }
+    v->end = i;
+    ++verse_count;
+    return 1;
+}
+
+/**
+ * This function skips the blanks into the source "source", from "i". If
+ * the source continues with "token", it returns the position after it,
+ * otherwise -1.
+ */
+static long match(int source, long i, const char* token)
+{
+    const char* text = sources[source];
+
+    while (i < source_sizes[source] && strchr(" \t\r\n", text[i])) {
+        ++i;
+    }
+    if (strncmp(text + i, token, strlen(token)) != 0) {
+        return -1;
+    }
+    return i + (long)strlen(token);
+}
+
+/**
+ * This function reads the block of the language "language" that starts
+ * (with the opening brace) from "i" into the source "source". It returns
+ * the position after the closing brace, or -1 if any error occours.
+ */
+static long read_block(int source, long i, int language)
+{
+    const char* text = sources[source];
+    long next;
+
+    if ((i = match(source, i, "{")) < 0) {
+        return -1;
+    }
+    while ((next = match(source, i, "}")) < 0) {
+        if (verse_count >= MAX_STRINGS) {
+            return -1;
+        }
+        if ((next = match(source, i, PAUSE)) >= 0) {
+            verses[verse_count].source = source;
+            verses[verse_count].language = language;
+            verses[verse_count].pause = 1;
+            verses[verse_count].start = i;
+            verses[verse_count].end = next;
+            verses[verse_count].length = 0;
+            ++verse_count;
+        } else if ((next = match(source, i, FUNCTION)) >= 0 && text[next] == '"' &&
+                        read_verse(source, next, language)) {
+            next = match(source, verses[verse_count - 1].end + 1, ");");
+        } else {
+            return -1;
+        }
+        if ((i = next) < 0) {
+            return -1;
+        }
+    }
+    return next;
+}
+
+/**
+ * This function reads the source named "name", and all its verses.
+ * It returns 0 if any error occours.
+ */
+static int read_source(const char* name)
+{
+    FILE* f = fopen(name, "rb");
+    char* text;
+    long size;
+    char* p;
+    long end;
+    int source = source_count;
+
+    if (f == NULL || source_count >= MAX_SOURCES) {
+        perror(name);
+        return 0;
+    }
+    text = malloc(MAX_SOURCE + 1);
+    size = (long)fread(text, 1, MAX_SOURCE, f);
+    fclose(f);
+    text[size] = 0;
+
+    sources[source] = text;
+    source_sizes[source] = size;
+    block_starts[source] = -1;
+    block_ends[source] = -1;
+
+    // The block with the languages, if any, comes first.
+    p = strstr(text, LANGUAGE_BLOCK);
+    if (p != NULL) {
+        end = read_block(source, p - text + (long)strlen(LANGUAGE_BLOCK), 0);
+        if (end >= 0) {
+            end = match(source, end, "else");
+        }
+        if (end >= 0) {
+            end = read_block(source, end, 1);
+        }
+        if (end < 0 || strstr(text + end, LANGUAGE_BLOCK) != NULL) {
+            fprintf(stderr, "%s: the block of the languages must have only write_verse() with a string, of at most %d characters, "
+                            "and %s, and it must be only one\n", name, MAX_VERSE, PAUSE);
+            return 0;
+        }
+        block_starts[source] = p - text;
+        block_ends[source] = end;
+        block_modules[source] = next_module;
+        next_module += LANGUAGES;
+    }
+
+    for (p = strstr(text, FUNCTION); p != NULL; p = strstr(p + 1, FUNCTION)) {
+        char* quote = p + strlen(FUNCTION);
+        // Only the literal strings are compressed (and not the prototype),
+        // and the ones into the block of the languages are already read.
+        if (*quote != '"' || (p - text >= block_starts[source] && p - text < block_ends[source])) {
+            continue;
+        }
+        if (verse_count >= MAX_STRINGS || !read_verse(source, quote - text, -1)) {
+            fprintf(stderr, "%s: string not valid, longer than %d characters, or too many strings\n", name, MAX_VERSE);
+            return 0;
+        }
+    }
+
+    ++source_count;
+    return 1;
+}
+
+/****************************************************************************
+ ** DICTIONARY FUNCTIONS
+ ****************************************************************************/
+
+/**
+ * This function compares two candidates, by their symbols.
+ */
+static int compare_symbols(const candidate* a, const candidate* b)
+{
+    const int* sa = verses[a->verse].symbols + a->start;
+    const int* sb = verses[b->verse].symbols + b->start;
+    int length = a->length < b->length ? a->length : b->length;
+    int i;
+
+    for (i = 0; i < length; ++i) {
+        if (sa[i] != sb[i]) {
+            return sa[i] - sb[i];
+        }
+    }
+    return a->length - b->length;
+}
+
+/**
+ * This function compares two candidates, by their symbols and then by their
+ * position: so the occurrences of the same symbols are in the same order as
+ * into the strings.
+ */
+static int compare_candidates(const void* a, const void* b)
+{
+    const candidate* ca = a;
+    const candidate* cb = b;
+    int result = compare_symbols(ca, cb);
+
+    if (result != 0) {
+        return result;
+    }
+    if (ca->verse != cb->verse) {
+        return ca->verse - cb->verse;
+    }
+    return ca->start - cb->start;
+}
+
+/**
+ * This function tells if the candidates "a" and "b" have the same symbols.
+ */
+static int same_candidates(const candidate* a, const candidate* b)
+{
+    return a->length == b->length && compare_symbols(a, b) == 0;
+}
+
+/**
+ * This function replaces all the occurrences (not overlapped) of the
+ * symbols of "entry" with the symbol "token".
+ */
+static void replace(const int* entry, int length, int token)
+{
+    int i;
+
+    for (i = 0; i < verse_count; ++i) {
+        verse* v = &verses[i];
+        int from;
+        int to = 0;
+        for (from = 0; from < v->length; ) {
+            if (from + length <= v->length && memcmp(v->symbols + from, entry, length * sizeof(int)) == 0) {
+                v->symbols[to++] = token;
+                from += length;
+            } else {
+                v->symbols[to++] = v->symbols[from++];
+            }
+        }
+        v->length = to;
+    }
+}
+
+/**
+ * This function builds the dictionary: at each step, the substring that
+ * saves more bytes becomes a new entry, until no one saves anything.
+ */
+static void build_dictionary(void)
+{
+    offsets[0] = 0;
+
+    while (entry_count < MAX_ENTRIES) {
+        long best_saving = 0;
+        candidate best = { 0, 0, 0 };
+        int entry[MAX_LENGTH];
+        long i;
+        int j;
+
+        // All the substrings made only by characters are candidates.
+        candidate_count = 0;
+        for (i = 0; i < verse_count; ++i) {
+            const verse* v = &verses[i];
+            int start;
+            for (start = 0; start < v->length; ++start) {
+                int length;
+                for (length = 1; length <= MAX_LENGTH && start + length <= v->length; ++length) {
+                    if (v->symbols[start + length - 1] >= TOKEN) {
+                        break;
+                    }
+                    if (length >= MIN_LENGTH && offsets[entry_count] + length <= MAX_DICTIONARY &&
+                            candidate_count < (long)(sizeof(candidates) / sizeof(candidates[0]))) {
+                        candidates[candidate_count].verse = (int)i;
+                        candidates[candidate_count].start = start;
+                        candidates[candidate_count].length = length;
+                        ++candidate_count;
+                    }
+                }
+            }
+        }
+        qsort(candidates, (size_t)candidate_count, sizeof(candidate), compare_candidates);
+
+        // Each occurrence saves "length - 1" bytes, while the entry costs
+        // "length" bytes (plus one for its position). Only the occurrences
+        // that do not overlap the previous one can be replaced (see
+        // replace()), and they are counted in the same order.
+        for (i = 0; i < candidate_count; ) {
+            const candidate* last = &candidates[i];
+            long group = 1;
+            long count = 1;
+            long saving;
+            while (i + group < candidate_count && same_candidates(&candidates[i], &candidates[i + group])) {
+                const candidate* c = &candidates[i + group];
+                if (c->verse != last->verse || c->start >= last->start + last->length) {
+                    last = c;
+                    ++count;
+                }
+                ++group;
+            }
+            saving = count * (candidates[i].length - 1) - candidates[i].length - 1;
+            if (saving > best_saving) {
+                best_saving = saving;
+                best = candidates[i];
+            }
+            i += group;
+        }
+        if (best_saving <= 0) {
+            break;
+        }
+
+        for (j = 0; j < best.length; ++j) {
+            entry[j] = verses[best.verse].symbols[best.start + j];
+            dictionary[offsets[entry_count] + j] = (unsigned char)entry[j];
+        }
+        replace(entry, best.length, TOKEN + entry_count);
+        offsets[entry_count + 1] = offsets[entry_count] + best.length;
+        ++entry_count;
+    }
+}
+
+/****************************************************************************
+ ** OUTPUT FUNCTIONS
+ ****************************************************************************/
+
+/**
+ * This function writes the compressed symbols of the verse "v", separated
+ * by commas. It returns the number of bytes written.
+ */
+static int write_symbols(FILE* f, const verse* v)
+{
+    int bytes = 0;
+    int i;
+
+    for (i = 0; i < v->length; ++i) {
+        int s = v->symbols[i];
+        if (s >= TOKEN) {
+            s = TOKEN_FIRST + s - TOKEN;
+        } else if (s >= TOKEN_FIRST && s <= TOKEN_ESCAPE) {
+            fprintf(f, "0x%02x, ", TOKEN_ESCAPE);
+            ++bytes;
+        }
+        fprintf(f, "0x%02x, ", s);
+        ++bytes;
+    }
+    fprintf(f, "0x00");
+    return bytes + 1;
+}
+
+/**
+ * This function writes the name of the array with the text of the
+ * language "language" of the source "name".
+ */
+static void write_name(FILE* f, const char* name, int language)
+{
+    const char* base = strrchr(name, '/');
+
+    base = base ? base + 1 : name;
+    fprintf(f, "text_%.*s_%s", (int)strcspn(base, "."), base, languages[language]);
+}
+
+/**
+ * This function writes the copy of the source "source" into the directory
+ * "directory", where the verses are replaced by the compressed arrays and
+ * the block of the languages by a call to write_text(). The arrays are
+ * defined before the comment of the first function that uses them. It
+ * returns the number of bytes of the compressed verses, or -1 if any error
+ * occours.
+ */
+static long write_source(const char* directory, const char* name, int source)
+{
+    const char* text = sources[source];
+    const char* base = strrchr(name, '/');
+    char path[1024];
+    long position = 0;
+    long first = block_starts[source];
+    long insert = -1;
+    long bytes = 0;
+    int count = 0;
+    int i;
+    FILE* f;
+
+    base = base ? base + 1 : name;
+    snprintf(path, sizeof(path), "%s/%s", directory, base);
+
+    for (i = 0; i < verse_count; ++i) {
+        if (verses[i].source == source && verses[i].language < 0) {
+            if (first < 0 || verses[i].start < first) {
+                first = verses[i].start;
+            }
+            break;
+        }
+    }
+    if (first >= 0) {
+        for (insert = first; insert > 0; --insert) {
+            if (text[insert - 1] == '\n' && strncmp(text + insert, "/**", 3) == 0) {
+                break;
+            }
+        }
+        if (insert <= 0) {
+            fprintf(stderr, "%s: no function comment before the first verse\n", name);
+            return -1;
+        }
+    }
+
+    f = fopen(path, "wb");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    fprintf(f, "// This file has been generated by ovltext from %s: do not edit it.\n\n", name);
+    if (first >= 0) {
+        fwrite(text, 1, (size_t)insert, f);
+        if (block_starts[source] >= 0) {
+            fprintf(f, "// Text of each language, into modules of their own (see tools/ovltext.c).\n");
+            for (i = 0; i < LANGUAGES; ++i) {
+                fprintf(f, "extern const unsigned char ");
+                write_name(f, name, i);
+                fprintf(f, "[];\n");
+            }
+            fprintf(f, "\n");
+        }
+        for (i = 0; i < verse_count; ++i) {
+            if (verses[i].source == source && verses[i].language < 0) {
+                if (count == 0) {
+                    fprintf(f, "// Compressed verses (see tools/ovltext.c).\n");
+                }
+                fprintf(f, "static const unsigned char verse%d[] = { ", count++);
+                bytes += write_symbols(f, &verses[i]);
+                fprintf(f, " };\n");
+            }
+        }
+        if (count > 0) {
+            fprintf(f, "\n");
+        }
+        position = insert;
+        count = 0;
+        for (i = 0; i < verse_count; ++i) {
+            if (verses[i].source != source || verses[i].language >= 0) {
+                continue;
+            }
+            if (block_starts[source] >= position && block_starts[source] < verses[i].start) {
+                break;
+            }
+            fwrite(text + position, 1, (size_t)(verses[i].start - position), f);
+            fprintf(f, "(char*)verse%d", count++);
+            position = verses[i].end + 1;
+        }
+        if (block_starts[source] >= position) {
+            // The verses after the block are not supported, for simplicity.
+            if (i < verse_count && verses[i].source == source) {
+                fprintf(stderr, "%s: no verse can follow the block of the languages\n", name);
+                fclose(f);
+                return -1;
+            }
+            fwrite(text + position, 1, (size_t)(block_starts[source] - position), f);
+            fprintf(f, "write_text(%d + language, language ? ", block_modules[source]);
+            write_name(f, name, 1);
+            fprintf(f, " : ");
+            write_name(f, name, 0);
+            fprintf(f, ");");
+            position = block_ends[source];
+        }
+    }
+    fwrite(text + position, 1, (size_t)(source_sizes[source] - position), f);
+
+    if (fclose(f) != 0) {
+        perror(path);
+        return -1;
+    }
+    return bytes;
+}
+
+/**
+ * This function writes the modules with the text of each language of the
+ * source "source" into the directory "directory": each verse is followed
+ * by its end, and the whole text by TOKEN_END. It returns the number of
+ * bytes of the compressed text, or -1 if any error occours.
+ */
+static long write_texts(const char* directory, const char* name, int source)
+{
+    const char* base = strrchr(name, '/');
+    char path[1024];
+    long bytes = 0;
+    int language;
+    int i;
+    FILE* f;
+
+    base = base ? base + 1 : name;
+
+    for (language = 0; language < LANGUAGES && block_starts[source] >= 0; ++language) {
+        snprintf(path, sizeof(path), "%s/%.*s.%s.c", directory, (int)strcspn(base, "."), base, languages[language]);
+        f = fopen(path, "wb");
+        if (f == NULL) {
+            perror(path);
+            return -1;
+        }
+
+        fprintf(f, "// This file has been generated by ovltext from %s: do not edit it.\n\n", name);
+        fprintf(f, "#include \"main.h\"\n\n");
+        fprintf(f, "#ifdef __OVERLAY__\n\n");
+        fprintf(f, "    // The text is the only content of the module.\n");
+        fprintf(f, "    #pragma rodata-name (\"OVERLAY%d\");\n\n", block_modules[source] + language);
+        fprintf(f, "#endif\n\n");
+        fprintf(f, "// Compressed verses of the language \"%s\" (see tools/ovltext.c).\n", languages[language]);
+        fprintf(f, "const unsigned char ");
+        write_name(f, name, language);
+        fprintf(f, "[] = {\n");
+        for (i = 0; i < verse_count; ++i) {
+            if (verses[i].source == source && verses[i].language == language) {
+                if (verses[i].pause) {
+                    fprintf(f, "    0x%02x,\n", TOKEN_PAUSE);
+                    ++bytes;
+                } else {
+                    fprintf(f, "    ");
+                    bytes += write_symbols(f, &verses[i]);
+                    fprintf(f, ",\n");
+                }
+            }
+        }
+        fprintf(f, "    0x%02x\n};\n", TOKEN_END);
+        ++bytes;
+
+        if (fclose(f) != 0) {
+            perror(path);
+            return -1;
+        }
+    }
+    return bytes;
+}
+
+/**
+ * This function writes the dictionary into the directory "directory".
+ * It returns 0 if any error occours.
+ */
+static int write_dictionary(const char* directory)
+{
+    char path[1024];
+    FILE* f;
+    int i;
+
+    snprintf(path, sizeof(path), "%s/dictionary.c", directory);
+    f = fopen(path, "wb");
+    if (f == NULL) {
+        perror(path);
+        return 0;
+    }
+
+    fprintf(f, "// This file has been generated by ovltext: do not edit it.\n\n");
+    fprintf(f, "#include \"main.h\"\n\n");
+    fprintf(f, "// Position of each entry of the dictionary (and end of the last one).\n");
+    fprintf(f, "const unsigned char text_offsets[] = {");
+    for (i = 0; i <= entry_count; ++i) {
+        fprintf(f, "%s%s%d", i ? "," : "", (i % 16) ? " " : "\n    ", offsets[i]);
+    }
+    fprintf(f, "\n};\n\n");
+    fprintf(f, "// Characters of the entries (in %s).\n", ascii_text ? "ASCII" : "PETSCII");
+    fprintf(f, "const unsigned char text_dictionary[] = {");
+    for (i = 0; i < offsets[entry_count]; ++i) {
+        fprintf(f, "%s%s0x%02x", i ? "," : "", (i % 12) ? " " : "\n    ", dictionary[i]);
+    }
+    // The array must not be empty.
+    if (offsets[entry_count] == 0) {
+        fprintf(f, "\n    0x00");
+    }
+    fprintf(f, "\n};\n");
+
+    if (fclose(f) != 0) {
+        perror(path);
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char* argv[])
+{
+    long original = 0;
+    long compressed = 0;
+    long texts = 0;
+    int count = 0;
+    int i;
+
+    if (argc > 1 && strcmp(argv[1], "-a") == 0) {
+        ascii_text = 1;
+        argv[1] = argv[0];
+        ++argv;
+        --argc;
+    }
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s [-a] <output directory> <first text module> <source> [<source> ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    next_module = atoi(argv[2]);
+    for (i = 3; i < argc; ++i) {
+        if (!read_source(argv[i])) {
+            return EXIT_FAILURE;
+        }
+    }
+    for (i = 0; i < verse_count; ++i) {
+        // Plus the end of the string.
+        if (!verses[i].pause) {
+            original += verses[i].length + 1;
+            ++count;
+        }
+    }
+
+    build_dictionary();
+
+    for (i = 0; i < source_count; ++i) {
+        long bytes = write_source(argv[1], argv[i + 3], i);
+        long text = write_texts(argv[1], argv[i + 3], i);
+        if (bytes < 0 || text < 0) {
+            return EXIT_FAILURE;
+        }
+        compressed += bytes;
+        texts += text;
+    }
+    if (!write_dictionary(argv[1])) {
+        return EXIT_FAILURE;
+    }
+
+    printf("ovltext: %d verses, %ld bytes -> %ld bytes (%ld into the text modules, + %d bytes of dictionary, %d entries)\n",
+                count, original, compressed + texts, texts, offsets[entry_count] + entry_count + 1, entry_count);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,272 @@
+/****************************************************************************
+ * ovl - Overlay Example on unexpanded 6502 retrocomputers                  *
+ *                                                                          *
+ * Copyright (c) 2020 by Marco Spedaletti. Licensed under CC-BY-NC-SA       *
+ *--------------------------------------------------------------------------*
+ * HOST TOOL: OVERLAY MODULES POSITIONS                                     *
+ ****************************************************************************/
+
+// This program is executed on the host (not on the retrocomputer) during
+// the build, after all the files have been written into the disk image. It
+// looks for the overlay modules into the directory of the image and it
+// writes their position (track and sector of the first block, and number
+// of blocks) into the table of the resident program, directly into the
+// blocks of the image. So the overlay manager can read the modules without
+// asking the drive to look for them into the directory.
+//
+// The table is found by looking for its signature into the program: it is
+// followed by the number of modules expected, and then by 3 bytes (track,
+// sector, blocks) for each module. See the overlay_directory structure into
+// main.h.
+//
+// Usage: ovltrack <disk image> <program> <module> [<module> ...]
+
+/****************************************************************************
+ ** INCLUDE SECTION
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/****************************************************************************
+ ** DEFINITIONS SECTION
+ ****************************************************************************/
+
+// Size of a 1541 disk image (35 tracks), with or without the error bytes,
+// and of the 40 tracks variant.
+#define D64_SIZE            174848
+#define D64_SIZE_ERRORS     175531
+#define D64_SIZE_40         196608
+#define D64_SIZE_40_ERRORS  197376
+
+// Size of a block, and of the data part of a block.
+#define BLOCK               256
+#define BLOCK_DATA          254
+
+// Position of the directory.
+#define DIRECTORY_TRACK     18
+#define DIRECTORY_SECTOR    1
+
+// Size of a directory entry, and length of a file name.
+#define ENTRY_SIZE          32
+#define NAME_SIZE           16
+
+// Maximum number of blocks of a file.
+#define MAX_BLOCKS          683
+
+// Signature of the table into the resident program.
+static const unsigned char signature[] = { 0x4f, 0x56, 0x4c, 0x54, 0x52, 0x41, 0x43, 0x4b };
+
+/****************************************************************************
+ ** VARIABLES SECTION
+ ****************************************************************************/
+
+static unsigned char image[D64_SIZE_40_ERRORS];
+static long image_size;
+static int tracks;
+
+// Data of the resident program, and the position into the image of each
+// of its bytes (so that it can be patched).
+static unsigned char program[MAX_BLOCKS * BLOCK_DATA];
+static long positions[MAX_BLOCKS * BLOCK_DATA];
+static long program_size = 0;
+
+/****************************************************************************
+ ** FUNCTIONS SECTION
+ ****************************************************************************/
+
+/**
+ * This function returns the number of sectors of the track "track".
+ */
+static int sectors(int track)
+{
+    if (track <= 17) {
+        return 21;
+    } else if (track <= 24) {
+        return 19;
+    } else if (track <= 30) {
+        return 18;
+    }
+    return 17;
+}
+
+/**
+ * This function returns the offset of the block at "track" and "sector"
+ * into the image, or -1 if it does not exist.
+ */
+static long offset(int track, int sector)
+{
+    long result = 0;
+    int i;
+
+    if (track < 1 || track > tracks || sector < 0 || sector >= sectors(track)) {
+        return -1;
+    }
+    for (i = 1; i < track; ++i) {
+        result += sectors(i);
+    }
+    return (result + sector) * BLOCK;
+}
+
+/**
+ * This function converts the (ASCII) file name "name" into the padded
+ * PETSCII one, as it is written into the directory by cc1541.
+ */
+static void petscii(const char* name, unsigned char* result)
+{
+    int i;
+
+    for (i = 0; i < NAME_SIZE; ++i) {
+        unsigned char c = 0xa0;
+        if (*name) {
+            c = (unsigned char)*name++;
+            if (c >= 'a' && c <= 'z') {
+                c = (unsigned char)(c - 'a' + 0x41);
+            } else if (c >= 'A' && c <= 'Z') {
+                c = (unsigned char)(c - 'A' + 0xc1);
+            }
+        }
+        result[i] = c;
+    }
+}
+
+/**
+ * This function looks for the file named "name" into the directory. It
+ * returns the offset of its entry into the image, or -1 if not found.
+ */
+static long find(const char* name)
+{
+    unsigned char wanted[NAME_SIZE];
+    int track = DIRECTORY_TRACK;
+    int sector = DIRECTORY_SECTOR;
+    int visited = 0;
+
+    petscii(name, wanted);
+
+    while (track != 0 && visited++ < sectors(DIRECTORY_TRACK)) {
+        long block = offset(track, sector);
+        int i;
+        if (block < 0) {
+            return -1;
+        }
+        for (i = 0; i < BLOCK; i += ENTRY_SIZE) {
+            const unsigned char* entry = image + block + i;
+            if (entry[2] != 0 && memcmp(entry + 5, wanted, NAME_SIZE) == 0) {
+                return block + i;
+            }
+        }
+        track = image[block];
+        sector = image[block + 1];
+    }
+    return -1;
+}
+
+/**
+ * This function reads the data of the file that starts from "track" and
+ * "sector" into the program buffer, remembering where each byte is.
+ * It returns 0 if the chain of blocks is broken.
+ */
+static int read_program(int track, int sector)
+{
+    int blocks = 0;
+
+    while (track != 0) {
+        long block = offset(track, sector);
+        int last;
+        int i;
+        if (block < 0 || ++blocks > MAX_BLOCKS) {
+            return 0;
+        }
+        last = image[block] ? BLOCK - 1 : image[block + 1];
+        for (i = 2; i <= last; ++i) {
+            program[program_size] = image[block + i];
+            positions[program_size] = block + i;
+            ++program_size;
+        }
+        track = image[block];
+        sector = image[block + 1];
+    }
+    return 1;
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* f;
+    long entry;
+    long table;
+    int modules;
+    int i;
+
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s <disk image> <program> <module> [<module> ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    image_size = (long)fread(image, 1, sizeof(image), f);
+    fclose(f);
+
+    if (image_size == D64_SIZE || image_size == D64_SIZE_ERRORS) {
+        tracks = 35;
+    } else if (image_size == D64_SIZE_40 || image_size == D64_SIZE_40_ERRORS) {
+        tracks = 40;
+    } else {
+        fprintf(stderr, "%s: not a D64 disk image\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    // Find the table into the resident program.
+    entry = find(argv[2]);
+    if (entry < 0 || !read_program(image[entry + 3], image[entry + 4])) {
+        fprintf(stderr, "%s: program \"%s\" not found\n", argv[1], argv[2]);
+        return EXIT_FAILURE;
+    }
+    for (table = 0; table + (long)sizeof(signature) < program_size; ++table) {
+        if (memcmp(program + table, signature, sizeof(signature)) == 0) {
+            break;
+        }
+    }
+    modules = argc - 3;
+    table += sizeof(signature);
+    if (table >= program_size || table + 1 + modules * 3 > program_size) {
+        fprintf(stderr, "%s: table not found into \"%s\"\n", argv[1], argv[2]);
+        return EXIT_FAILURE;
+    }
+    if (program[table] != modules) {
+        fprintf(stderr, "%s: \"%s\" expects %d modules, not %d\n", argv[1], argv[2], program[table], modules);
+        return EXIT_FAILURE;
+    }
+
+    // Write the position of each module.
+    for (i = 0; i < modules; ++i) {
+        long position = table + 1 + i * 3;
+        entry = find(argv[3 + i]);
+        if (entry < 0) {
+            fprintf(stderr, "%s: module \"%s\" not found\n", argv[1], argv[3 + i]);
+            return EXIT_FAILURE;
+        }
+        image[positions[position]] = image[entry + 3];
+        image[positions[position + 1]] = image[entry + 4];
+        // The number of blocks is saturated to 255.
+        image[positions[position + 2]] = image[entry + 31] ? 255 : image[entry + 30];
+        printf("ovltrack: %s: track %d, sector %d, %d blocks\n",
+                    argv[3 + i], image[entry + 3], image[entry + 4], image[entry + 30] | (image[entry + 31] << 8));
+    }
+
+    f = fopen(argv[1], "wb");
+    if (f == NULL) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    if (fwrite(image, 1, (size_t)image_size, f) != (size_t)image_size || fclose(f) != 0) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}